@@ -1,261 +1,5101 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <latch>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <new>
+#include <optional>
+#include <poll.h>
+#include <random>
 #include <sstream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 constexpr float MARGIN_X_PERCENT = 0.05f;
 constexpr float MARGIN_Y_PERCENT = 0.05f;
 constexpr float MIN_VIEW_WIDTH = 5.f;
 constexpr auto MODAL_FILL = sf::Color(255, 255, 200);
+constexpr float MODAL_PADDING = 5.f;
 constexpr float CANDLE_WIDTH_FACTOR = 0.8f;
 constexpr float SPACING_FACTOR = 0.2f;
 constexpr int NUM_HORIZONTAL_GRID_LINES = 5;
 constexpr auto LIGHT_GRAY = sf::Color(240, 240, 240);
+constexpr size_t NO_CANDLE = SIZE_MAX;
+const sf::Time LIVE_POLL_INTERVAL = sf::microseconds(250);
+const sf::Time LOADING_REFRESH_INTERVAL = sf::milliseconds(50);
+
+// Counts heap allocations program-wide while the profiler or the benchmark
+// sets countingAllocations. Otherwise an allocation only pays for a relaxed
+// load of the flag.
+std::atomic<bool> countingAllocations{false};
+std::atomic<uint64_t> heapAllocations{0};
+
+inline void countAllocation()
+{
+  if (countingAllocations.load(std::memory_order_relaxed))
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+  countAllocation();
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  countAllocation();
+  size_t align = static_cast<size_t>(alignment);
+  if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align))
+    return p;
+  throw std::bad_alloc();
+}
+// Out of line so GCC does not flag the free() as mismatched with new
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { ::operator delete(p); }
+void operator delete(void *p, std::align_val_t) noexcept
+{
+  ::operator delete(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+  ::operator delete(p);
+}
+
+// Draw calls submitted through submitDraw, for the profiler.
+uint64_t drawCalls = 0;
+
+template <typename... Args>
+void submitDraw(sf::RenderTarget &target, const Args &...args)
+{
+  ++drawCalls;
+  target.draw(args...);
+}
+
+// Frame profiler: scoped timers per main loop phase plus draw call and
+// allocation counts. Timers cost one branch while profiling is off; build
+// with -DCANDLESTICKS_NO_PROFILER to compile them out entirely.
+enum ProfilePhase {
+  PHASE_EVENTS,
+  PHASE_FEED,
+  PHASE_MINMAX,
+  PHASE_HOVER,
+  PHASE_GRID,
+  PHASE_CANDLES,
+  PHASE_LABELS,
+  PHASE_INDICATORS,
+  PHASE_VOLUME_PROFILE,
+  PHASE_ANNOTATION_INDEX,
+  PHASE_LINES,
+  PHASE_RECTS,
+  PHASE_TEXTS,
+  PHASE_COMPOSITE,
+  PHASE_DISPLAY,
+  NUM_PHASES
+};
+
+constexpr const char *PHASE_NAMES[NUM_PHASES] = {
+    "events",  "feed",       "minmax",     "hover",     "grid",
+    "candles", "labels",     "indicators", "volume",    "index",
+    "lines",   "rectangles", "texts",      "composite", "display"};
+
+struct TraceEvent {
+  int phase; // NUM_PHASES for a whole frame
+  double startUs, durationUs;
+  uint32_t drawCalls, allocations; // Whole frames only
+};
+
+struct FrameProfiler {
+  static constexpr size_t HISTORY = 120;
+  static constexpr size_t MAX_TRACE_EVENTS = 1 << 22;
+
+  using Clock = std::chrono::steady_clock;
+  bool enabled = false; // HUD shown or trace requested
+  bool tracing = false;
+  Clock::time_point origin = Clock::now(), frameStart;
+  std::array<double, NUM_PHASES> phaseUs{}; // Current frame
+  uint64_t drawCallsAtStart = 0, allocationsAtStart = 0;
+
+  // Rolling window over the last HISTORY frames
+  std::array<std::array<float, NUM_PHASES>, HISTORY> phaseHistory{};
+  std::array<float, HISTORY> frameMs{}, drawCallHistory{},
+      allocationHistory{};
+  size_t numFrames = 0;
+
+  std::vector<TraceEvent> trace;
+};
+
+FrameProfiler frameProfiler;
+
+double profilerMicroseconds(FrameProfiler::Clock::time_point time)
+{
+  return std::chrono::duration<double, std::micro>(time -
+                                                   frameProfiler.origin)
+      .count();
+}
+
+struct ScopedTimer {
+#ifndef CANDLESTICKS_NO_PROFILER
+  ProfilePhase phase;
+  bool active;
+  FrameProfiler::Clock::time_point start;
+
+  explicit ScopedTimer(ProfilePhase phase)
+      : phase(phase), active(frameProfiler.enabled)
+  {
+    if (active)
+      start = FrameProfiler::Clock::now();
+  }
+  ~ScopedTimer() { stop(); }
+
+  // Ends the phase before the end of the scope.
+  void stop()
+  {
+    if (!active)
+      return;
+    active = false;
+    auto end = FrameProfiler::Clock::now();
+    double startUs = profilerMicroseconds(start);
+    double durationUs = profilerMicroseconds(end) - startUs;
+    frameProfiler.phaseUs[phase] += durationUs;
+    if (frameProfiler.tracing &&
+        frameProfiler.trace.size() < FrameProfiler::MAX_TRACE_EVENTS)
+      frameProfiler.trace.push_back({phase, startUs, durationUs, 0, 0});
+  }
+#else
+  explicit ScopedTimer(ProfilePhase) {}
+  void stop() {}
+#endif
+};
+
+void beginFrame(FrameProfiler &profiler)
+{
+  if (!profiler.enabled)
+    return;
+  profiler.frameStart = FrameProfiler::Clock::now();
+  profiler.phaseUs.fill(0.0);
+  profiler.drawCallsAtStart = drawCalls;
+  profiler.allocationsAtStart = heapAllocations.load();
+}
+
+void endFrame(FrameProfiler &profiler)
+{
+  if (!profiler.enabled)
+    return;
+  double startUs = profilerMicroseconds(profiler.frameStart);
+  double durationUs =
+      profilerMicroseconds(FrameProfiler::Clock::now()) - startUs;
+  auto frameDrawCalls =
+      static_cast<uint32_t>(drawCalls - profiler.drawCallsAtStart);
+  auto frameAllocations = static_cast<uint32_t>(heapAllocations.load() -
+                                                profiler.allocationsAtStart);
+  size_t slot = profiler.numFrames++ % FrameProfiler::HISTORY;
+  for (int i = 0; i < NUM_PHASES; ++i)
+    profiler.phaseHistory[slot][i] = static_cast<float>(profiler.phaseUs[i]);
+  profiler.frameMs[slot] = static_cast<float>(durationUs / 1000.0);
+  profiler.drawCallHistory[slot] = static_cast<float>(frameDrawCalls);
+  profiler.allocationHistory[slot] = static_cast<float>(frameAllocations);
+  if (profiler.tracing &&
+      profiler.trace.size() < FrameProfiler::MAX_TRACE_EVENTS)
+    profiler.trace.push_back(
+        {NUM_PHASES, startUs, durationUs, frameDrawCalls, frameAllocations});
+}
+
+// Writes recorded timers as Chrome trace events (chrome://tracing,
+// Perfetto), with per-frame draw call and allocation counters.
+bool writeChromeTrace(const std::string &filename,
+                      const FrameProfiler &profiler)
+{
+  std::ofstream out(filename);
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+  for (size_t i = 0; i < profiler.trace.size(); ++i) {
+    const TraceEvent &event = profiler.trace[i];
+    const char *name =
+        event.phase == NUM_PHASES ? "frame" : PHASE_NAMES[event.phase];
+    out << (i ? ",\n" : "\n") << "{\"name\": \"" << name
+        << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": "
+        << event.startUs << ", \"dur\": " << event.durationUs << "}";
+    if (event.phase == NUM_PHASES)
+      out << ",\n{\"name\": \"frame\", \"ph\": \"C\", \"pid\": 1, \"ts\": "
+          << event.startUs << ", \"args\": {\"draw_calls\": "
+          << event.drawCalls << ", \"allocations\": " << event.allocations
+          << "}}";
+  }
+  out << "\n]}" << std::endl;
+  return static_cast<bool>(out);
+}
+
+// Draws rolling averages over the profiler history and a frame time
+// sparkline in the top right corner. The text is refreshed every few
+// frames to stay readable.
+void drawProfilerHud(sf::RenderTarget &target, sf::Text &text,
+                     sf::RectangleShape &background,
+                     sf::VertexArray &sparkline,
+                     const FrameProfiler &profiler, float width)
+{
+  constexpr float HUD_WIDTH = 230.f, SPARKLINE_HEIGHT = 40.f;
+  constexpr float SPARKLINE_MAX_MS = 33.3f;
+  constexpr size_t TEXT_REFRESH_FRAMES = 10;
+  size_t count = std::min(profiler.numFrames, FrameProfiler::HISTORY);
+  if (count == 0)
+    return;
+
+  if (profiler.numFrames % TEXT_REFRESH_FRAMES == 1 ||
+      text.getString().isEmpty()) {
+    std::array<double, NUM_PHASES> phaseSums{};
+    double frameSum = 0.0, frameMax = 0.0, drawCallSum = 0.0,
+           allocationSum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+      for (int phase = 0; phase < NUM_PHASES; ++phase)
+        phaseSums[phase] += profiler.phaseHistory[i][phase];
+      frameSum += profiler.frameMs[i];
+      frameMax = std::max<double>(frameMax, profiler.frameMs[i]);
+      drawCallSum += profiler.drawCallHistory[i];
+      allocationSum += profiler.allocationHistory[i];
+    }
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << "frame      "
+       << frameSum / count << " ms (max " << frameMax << ")\n";
+    for (int phase = 0; phase < NUM_PHASES; ++phase)
+      ss << std::left << std::setw(11) << PHASE_NAMES[phase] << std::right
+         << std::setprecision(1) << phaseSums[phase] / count << " us\n";
+    ss << "draw calls " << drawCallSum / count << "\n"
+       << "allocs     " << allocationSum / count;
+    text.setString(ss.str());
+  }
+
+  sf::FloatRect bounds = text.getLocalBounds();
+  sf::Vector2f origin(width - HUD_WIDTH - MODAL_PADDING, MODAL_PADDING);
+  background.setPosition(origin);
+  background.setSize({HUD_WIDTH, bounds.size.y + SPARKLINE_HEIGHT +
+                                     3 * MODAL_PADDING});
+  text.setPosition(origin + sf::Vector2f(MODAL_PADDING, MODAL_PADDING));
+  submitDraw(target, background);
+  submitDraw(target, text);
+
+  // Oldest frame on the left; the top of the sparkline is 30 fps
+  sparkline.setPrimitiveType(sf::PrimitiveType::LineStrip);
+  sparkline.resize(count);
+  float bottom = origin.y + bounds.size.y + SPARKLINE_HEIGHT +
+                 2 * MODAL_PADDING;
+  float step = (HUD_WIDTH - 2 * MODAL_PADDING) / FrameProfiler::HISTORY;
+  for (size_t i = 0; i < count; ++i) {
+    size_t slot = (profiler.numFrames - count + i) % FrameProfiler::HISTORY;
+    float ms = std::min(profiler.frameMs[slot], SPARKLINE_MAX_MS);
+    sparkline[i] = {{origin.x + MODAL_PADDING + i * step,
+                     bottom - ms / SPARKLINE_MAX_MS * SPARKLINE_HEIGHT},
+                    ms > 16.7f ? sf::Color::Red : sf::Color::Green};
+  }
+  submitDraw(target, sparkline);
+}
+
+// Build with -DCANDLESTICKS_FIXED_POINT to store prices as int32 ticks of
+// PRICE_TICK instead of floats.
+#ifdef CANDLESTICKS_FIXED_POINT
+#ifndef CANDLESTICKS_PRICE_TICK
+#define CANDLESTICKS_PRICE_TICK 0.0001
+#endif
+using Price = int32_t;
+constexpr double PRICE_TICK = CANDLESTICKS_PRICE_TICK;
+inline Price toPrice(float value)
+{
+  return static_cast<Price>(std::llround(value / PRICE_TICK));
+}
+inline float fromPrice(Price price)
+{
+  return static_cast<float>(price * PRICE_TICK);
+}
+#else
+using Price = float;
+constexpr double PRICE_TICK = 0.0;
+inline Price toPrice(float value) { return value; }
+inline float fromPrice(Price price) { return price; }
+#endif
 
 struct Candlestick {
   float open, close, high, low, volume;
-  std::string date;
+  int64_t time; // Seconds since the Unix epoch
+};
+
+struct ChartLine {
+  float startCandle, startPrice, endCandle, endPrice;
+};
+
+struct ChartRect {
+  float startCandle, startPrice, endCandle, endPrice;
+};
+
+struct ChartText {
+  float candle, price;
+  std::string text;
+};
+
+struct ParseStats {
+  size_t bytes = 0, rows = 0, errors = 0;
+  double seconds = 0.0;
+  bool fromCache = false;
+
+  double megabytesPerSecond() const
+  {
+    return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+  }
+};
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+struct MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  MappedFile() = default;
+  explicit MappedFile(const std::string &filename, int advice = MADV_NORMAL)
+  {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *ptr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                         MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+        data = static_cast<const char *>(ptr);
+        size = static_cast<size_t>(st.st_size);
+        ::madvise(ptr, size, advice);
+      }
+    }
+    ::close(fd);
+  }
+  MappedFile(MappedFile &&other) noexcept
+      : data(std::exchange(other.data, nullptr)),
+        size(std::exchange(other.size, 0))
+  {
+  }
+  MappedFile &operator=(MappedFile &&other) noexcept
+  {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile()
+  {
+    if (data)
+      ::munmap(const_cast<char *>(data), size);
+  }
+
+  explicit operator bool() const { return data != nullptr; }
+};
+
+// Growable array aligned to a cache line. A column may also borrow memory
+// owned elsewhere; appending or resizing copies it, but callers must not
+// write through operator[] while borrowing.
+template <typename T> struct Column {
+  static constexpr size_t ALIGNMENT = 64;
+
+  T *data = nullptr;
+  size_t size = 0;
+  size_t capacity = 0; // 0 while borrowing
+
+  Column() = default;
+  Column(Column &&other) noexcept
+      : data(std::exchange(other.data, nullptr)),
+        size(std::exchange(other.size, 0)),
+        capacity(std::exchange(other.capacity, 0))
+  {
+  }
+  Column &operator=(Column &&other) noexcept
+  {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(capacity, other.capacity);
+    return *this;
+  }
+  Column(const Column &) = delete;
+  Column &operator=(const Column &) = delete;
+  ~Column() { release(); }
+
+  void borrow(const T *borrowed, size_t count)
+  {
+    release();
+    data = const_cast<T *>(borrowed);
+    size = count;
+  }
+  void reserve(size_t count)
+  {
+    count = std::max(count, size);
+    if (count <= capacity)
+      return;
+    T *grown = static_cast<T *>(
+        ::operator new(count * sizeof(T), std::align_val_t(ALIGNMENT)));
+    if (size)
+      std::memcpy(grown, data, size * sizeof(T));
+    size_t keep = size;
+    release();
+    data = grown;
+    size = keep;
+    capacity = count;
+  }
+  void resize(size_t count)
+  {
+    reserve(count);
+    size = count;
+  }
+  void push_back(T value)
+  {
+    // A borrowed column has no capacity, so this also takes ownership
+    if (size >= capacity)
+      reserve(std::max<size_t>(ALIGNMENT, size * 2));
+    data[size++] = value;
+  }
+  void release()
+  {
+    if (capacity)
+      ::operator delete(data, std::align_val_t(ALIGNMENT));
+    data = nullptr;
+    size = capacity = 0;
+  }
+
+  T operator[](size_t i) const { return data[i]; }
+  T &operator[](size_t i) { return data[i]; }
+};
+
+// Structure-of-arrays candle store in chronological order. Hot loops touch
+// only the columns they need; dates are epoch seconds, formatted on demand.
+struct CandleSeries {
+  Column<Price> open, high, low, close;
+  Column<float> volume;
+  Column<int64_t> time;
+  MappedFile mapping; // Backs borrowed columns
+  uint64_t revision = 0; // Bumped on every change, for derived caches
+
+  size_t size() const { return time.size; }
+  bool empty() const { return time.size == 0; }
+
+  void reserve(size_t count)
+  {
+    open.reserve(count);
+    high.reserve(count);
+    low.reserve(count);
+    close.reserve(count);
+    volume.reserve(count);
+    time.reserve(count);
+  }
+  void resize(size_t count)
+  {
+    open.resize(count);
+    high.resize(count);
+    low.resize(count);
+    close.resize(count);
+    volume.resize(count);
+    time.resize(count);
+    ++revision;
+  }
+  void append(const Candlestick &candle)
+  {
+    open.push_back(toPrice(candle.open));
+    high.push_back(toPrice(candle.high));
+    low.push_back(toPrice(candle.low));
+    close.push_back(toPrice(candle.close));
+    volume.push_back(candle.volume);
+    time.push_back(candle.time);
+    ++revision;
+  }
+  void set(size_t i, const Candlestick &candle)
+  {
+    resize(size()); // Take ownership of borrowed columns before writing
+    open[i] = toPrice(candle.open);
+    high[i] = toPrice(candle.high);
+    low[i] = toPrice(candle.low);
+    close[i] = toPrice(candle.close);
+    volume[i] = candle.volume;
+    time[i] = candle.time;
+  }
+  Candlestick at(size_t i) const
+  {
+    return {fromPrice(open[i]), fromPrice(close[i]), fromPrice(high[i]),
+            fromPrice(low[i]),  volume[i],          time[i]};
+  }
+};
+
+// Minimum of lows[first..last] and maximum of highs[first..last]. Eight
+// independent accumulators let the compiler keep the reduction in vector
+// registers.
+template <typename T>
+void columnMinMax(const T *lows, const T *highs, size_t first, size_t last,
+                  T &minValue, T &maxValue)
+{
+  constexpr size_t LANES = 8;
+  T mins[LANES], maxs[LANES];
+  for (size_t j = 0; j < LANES; ++j) {
+    mins[j] = lows[first];
+    maxs[j] = highs[first];
+  }
+  size_t i = first;
+  for (; i + LANES <= last + 1; i += LANES) {
+    for (size_t j = 0; j < LANES; ++j) {
+      mins[j] = lows[i + j] < mins[j] ? lows[i + j] : mins[j];
+      maxs[j] = highs[i + j] > maxs[j] ? highs[i + j] : maxs[j];
+    }
+  }
+  for (; i <= last; ++i) {
+    mins[0] = lows[i] < mins[0] ? lows[i] : mins[0];
+    maxs[0] = highs[i] > maxs[0] ? highs[i] : maxs[0];
+  }
+  minValue = *std::min_element(mins, mins + LANES);
+  maxValue = *std::max_element(maxs, maxs + LANES);
+}
+
+// Range min/max over a pair of columns (lows and highs, or one column twice
+// for volumes and indicators). Whole blocks are answered from a sparse table
+// of block summaries in O(1); at most two partial blocks are scanned with
+// columnMinMax.
+template <typename T> struct RangeIndex {
+  static constexpr size_t BLOCK = 256;
+
+  std::vector<std::vector<T>> mins, maxs; // [k][b]: blocks b..b + 2^k - 1
+  size_t size = 0;
+};
+
+// Rebuilds the summaries that depend on elements from dirtyFrom onwards.
+// Pass 0 for a full build, or the previous size after appending.
+template <typename T>
+void updateRangeIndex(RangeIndex<T> &index, const T *lows, const T *highs,
+                      size_t size, size_t dirtyFrom = 0)
+{
+  constexpr size_t BLOCK = RangeIndex<T>::BLOCK;
+  size_t numBlocks = (size + BLOCK - 1) / BLOCK;
+  size_t dirtyBlock = std::min(dirtyFrom, index.size) / BLOCK;
+  index.size = size;
+  if (index.mins.empty()) {
+    index.mins.emplace_back();
+    index.maxs.emplace_back();
+  }
+  index.mins[0].resize(numBlocks);
+  index.maxs[0].resize(numBlocks);
+  for (size_t b = dirtyBlock; b < numBlocks; ++b)
+    columnMinMax(lows, highs, b * BLOCK, std::min(size, (b + 1) * BLOCK) - 1,
+                 index.mins[0][b], index.maxs[0][b]);
+  for (size_t k = 1; (size_t(1) << k) <= numBlocks; ++k) {
+    if (k == index.mins.size()) {
+      index.mins.emplace_back();
+      index.maxs.emplace_back();
+    }
+    size_t span = size_t(1) << k, half = span / 2;
+    auto &mins = index.mins[k], &maxs = index.maxs[k];
+    const auto &lowerMins = index.mins[k - 1], &lowerMaxs = index.maxs[k - 1];
+    mins.resize(numBlocks - span + 1);
+    maxs.resize(numBlocks - span + 1);
+    for (size_t b = dirtyBlock >= span ? dirtyBlock - span + 1 : 0;
+         b < mins.size(); ++b) {
+      mins[b] = std::min(lowerMins[b], lowerMins[b + half]);
+      maxs[b] = std::max(lowerMaxs[b], lowerMaxs[b + half]);
+    }
+  }
+}
+
+template <typename T>
+void queryRangeIndex(const RangeIndex<T> &index, const T *lows,
+                     const T *highs, size_t first, size_t last, T &minValue,
+                     T &maxValue)
+{
+  constexpr size_t BLOCK = RangeIndex<T>::BLOCK;
+  size_t firstBlock = (first + BLOCK - 1) / BLOCK;
+  size_t endBlock = (last + 1) / BLOCK; // One past the last whole block
+  if (firstBlock >= endBlock) {
+    columnMinMax(lows, highs, first, last, minValue, maxValue);
+    return;
+  }
+  size_t k = std::bit_width(endBlock - firstBlock) - 1;
+  size_t secondBlock = endBlock - (size_t(1) << k);
+  minValue = std::min(index.mins[k][firstBlock], index.mins[k][secondBlock]);
+  maxValue = std::max(index.maxs[k][firstBlock], index.maxs[k][secondBlock]);
+  T partMin, partMax;
+  if (first < firstBlock * BLOCK) {
+    columnMinMax(lows, highs, first, firstBlock * BLOCK - 1, partMin,
+                 partMax);
+    minValue = std::min(minValue, partMin);
+    maxValue = std::max(maxValue, partMax);
+  }
+  if (last >= endBlock * BLOCK) {
+    columnMinMax(lows, highs, endBlock * BLOCK, last, partMin, partMax);
+    minValue = std::min(minValue, partMin);
+    maxValue = std::max(maxValue, partMax);
+  }
+}
+
+// Multi-resolution copies of a series for drawing zoomed-out views.
+// levels[k] merges runs of 2^(k+1) base candles aligned to multiples of
+// 2^(k+1): first open, max high, min low, last close, summed volume.
+struct CandlePyramid {
+  std::vector<CandleSeries> levels;
+  size_t baseSize = 0;
+};
+
+// Recomputes every merged candle that depends on base candles from
+// dirtyFrom onwards. Pass 0 for a full build, or the previous size after
+// appending.
+void updateCandlePyramid(CandlePyramid &pyramid, const CandleSeries &base,
+                         size_t dirtyFrom = 0)
+{
+  dirtyFrom = std::min(dirtyFrom, pyramid.baseSize);
+  for (size_t level = 0;; ++level) {
+    const CandleSeries *source = level ? &pyramid.levels[level - 1] : &base;
+    if (source->size() <= 1)
+      break;
+    if (level == pyramid.levels.size()) {
+      pyramid.levels.emplace_back();
+      source = level ? &pyramid.levels[level - 1] : &base;
+    }
+    CandleSeries &merged = pyramid.levels[level];
+    size_t sourceSize = source->size();
+    size_t size = (sourceSize + 1) / 2;
+    dirtyFrom /= 2;
+    merged.resize(size);
+    for (size_t j = dirtyFrom; j < size; ++j) {
+      size_t a = 2 * j, b = std::min(a + 1, sourceSize - 1);
+      merged.open[j] = source->open[a];
+      merged.close[j] = source->close[b];
+      merged.high[j] = std::max(source->high[a], source->high[b]);
+      merged.low[j] = std::min(source->low[a], source->low[b]);
+      merged.volume[j] =
+          source->volume[a] + (b != a ? source->volume[b] : 0.f);
+      merged.time[j] = source->time[a];
+    }
+  }
+  pyramid.baseSize = base.size();
+}
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+constexpr int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = static_cast<unsigned>(y - era * 400);
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+void civilFromDays(int64_t z, int64_t &y, unsigned &m, unsigned &d)
+{
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = static_cast<unsigned>(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+// Parses a NASDAQ "MM/DD/YYYY" date into seconds since the epoch.
+bool parseDate(const char *begin, const char *end, int64_t &time)
+{
+  unsigned month = 0, day = 0;
+  int64_t year = 0;
+  auto r = std::from_chars(begin, end, month);
+  if (r.ec != std::errc() || r.ptr == end || *r.ptr != '/')
+    return false;
+  r = std::from_chars(r.ptr + 1, end, day);
+  if (r.ec != std::errc() || r.ptr == end || *r.ptr != '/')
+    return false;
+  r = std::from_chars(r.ptr + 1, end, year);
+  if (r.ec != std::errc() || r.ptr != end || month < 1 || month > 12 ||
+      day < 1 || day > 31)
+    return false;
+  time = daysFromCivil(year, month, day) * SECONDS_PER_DAY;
+  return true;
+}
+
+std::string formatDate(int64_t time)
+{
+  int64_t days = time >= 0 ? time / SECONDS_PER_DAY
+                           : (time - SECONDS_PER_DAY + 1) / SECONDS_PER_DAY;
+  int64_t year;
+  unsigned month, day;
+  civilFromDays(days, year, month, day);
+  char buffer[32];
+  int length = std::snprintf(buffer, sizeof(buffer), "%02u/%02u/%04lld",
+                             month, day, static_cast<long long>(year));
+  // Intraday bars also show the time of day
+  int64_t seconds = time - days * SECONDS_PER_DAY;
+  if (seconds != 0)
+    std::snprintf(buffer + length, sizeof(buffer) - length,
+                  seconds % 60 ? " %02d:%02d:%02d" : " %02d:%02d",
+                  static_cast<int>(seconds / 3600),
+                  static_cast<int>(seconds / 60 % 60),
+                  static_cast<int>(seconds % 60));
+  return buffer;
+}
+
+struct ParseError {
+  size_t line;
+  std::string message;
+};
+
+// Parses one number, skipping an optional leading '$' as used by NASDAQ
+// price columns.
+bool parseNumber(const char *begin, const char *end, float &value)
+{
+  if (begin != end && *begin == '$')
+    ++begin;
+  auto [ptr, ec] = std::from_chars(begin, end, value);
+  return ec == std::errc() && ptr == end;
+}
+
+// CSV layouts are declared as schemas: one CsvColumn per column, in file
+// order, naming the Candlestick field it fills and how its text is
+// written. parseRow is unrolled over the columns at compile time, so a row
+// is parsed in one pass with no per-column lookups.
+enum CandleField {
+  FIELD_TIME,
+  FIELD_TIME_OF_DAY, // Added to a preceding date column
+  FIELD_OPEN,
+  FIELD_HIGH,
+  FIELD_LOW,
+  FIELD_CLOSE,
+  FIELD_VOLUME,
+  FIELD_SKIP
+};
+
+enum ValueFormat {
+  VALUE_DECIMAL,
+  DATE_MDY,          // 01/31/2024
+  DATE_YMD,          // 2024-01-31, any separator, optional " 09:30[:00]"
+  EPOCH_SECONDS,
+  EPOCH_MILLISECONDS
+};
+
+template <CandleField Field, ValueFormat Format = VALUE_DECIMAL,
+          char Prefix = 0> // Optional leading character, such as '$'
+struct CsvColumn {
+  static constexpr CandleField field = Field;
+  static constexpr ValueFormat format = Format;
+  static constexpr char prefix = Prefix;
+};
+
+template <typename... Columns> struct CsvSchema {};
+
+constexpr const char *FIELD_ERRORS[] = {
+    "invalid date", "invalid time", "invalid open",   "invalid high",
+    "invalid low",  "invalid close", "invalid volume", "invalid field"};
+
+constexpr float Candlestick::*FIELD_MEMBERS[] = {
+    nullptr,          nullptr,           &Candlestick::open,
+    &Candlestick::high, &Candlestick::low, &Candlestick::close,
+    &Candlestick::volume};
+
+// Parses "HH:MM" or "HH:MM:SS" into seconds since midnight.
+bool parseTimeOfDay(const char *begin, const char *end, int64_t &seconds)
+{
+  unsigned hours = 0, minutes = 0, secs = 0;
+  auto r = std::from_chars(begin, end, hours);
+  if (r.ec != std::errc() || r.ptr == end || *r.ptr != ':')
+    return false;
+  r = std::from_chars(r.ptr + 1, end, minutes);
+  if (r.ec != std::errc())
+    return false;
+  if (r.ptr != end) {
+    if (*r.ptr != ':')
+      return false;
+    r = std::from_chars(r.ptr + 1, end, secs);
+    if (r.ec != std::errc() || r.ptr != end)
+      return false;
+  }
+  seconds = hours * 3600 + minutes * 60 + secs;
+  return hours < 24 && minutes < 60 && secs < 60;
+}
+
+// Parses a "YYYY-MM-DD" date, with any single-character separators and an
+// optional time of day after a space or 'T'.
+bool parseYmdDate(const char *begin, const char *end, int64_t &time)
+{
+  int64_t year = 0;
+  unsigned month = 0, day = 0;
+  auto r = std::from_chars(begin, end, year);
+  if (r.ec != std::errc() || r.ptr == end)
+    return false;
+  r = std::from_chars(r.ptr + 1, end, month);
+  if (r.ec != std::errc() || r.ptr == end)
+    return false;
+  r = std::from_chars(r.ptr + 1, end, day);
+  if (r.ec != std::errc() || month < 1 || month > 12 || day < 1 || day > 31)
+    return false;
+  time = daysFromCivil(year, month, day) * SECONDS_PER_DAY;
+  if (r.ptr == end)
+    return true;
+  int64_t seconds;
+  if ((*r.ptr != ' ' && *r.ptr != 'T') ||
+      !parseTimeOfDay(r.ptr + 1, end, seconds))
+    return false;
+  time += seconds;
+  return true;
+}
+
+template <ValueFormat Format>
+bool parseTime(const char *begin, const char *end, int64_t &time)
+{
+  if constexpr (Format == DATE_MDY) {
+    return parseDate(begin, end, time);
+  } else if constexpr (Format == DATE_YMD) {
+    return parseYmdDate(begin, end, time);
+  } else {
+    static_assert(Format == EPOCH_SECONDS || Format == EPOCH_MILLISECONDS,
+                  "not a date format");
+    // Seconds past the year 5000 are taken to be milliseconds, so the two
+    // cannot be mistaken for one another when sniffing a format
+    constexpr int64_t MAX_EPOCH_SECONDS = 100000000000;
+    auto [ptr, ec] = std::from_chars(begin, end, time);
+    if (ec != std::errc() || ptr != end)
+      return false;
+    if constexpr (Format == EPOCH_MILLISECONDS) {
+      time /= 1000;
+      return time >= MAX_EPOCH_SECONDS / 1000;
+    }
+    return time < MAX_EPOCH_SECONDS;
+  }
+}
+
+// Parses one column of a row into `candle` and advances `field` past it.
+// Returns an error message, or nullptr on success.
+template <typename Column>
+const char *parseColumn(const char *&field, const char *end,
+                        Candlestick &candle)
+{
+  if (field > end)
+    return "too few fields";
+  const char *fieldEnd = static_cast<const char *>(
+      std::memchr(field, ',', static_cast<size_t>(end - field)));
+  if (!fieldEnd)
+    fieldEnd = end;
+  const char *begin = field;
+  field = fieldEnd + 1;
+  if constexpr (Column::prefix != 0) {
+    if (begin != fieldEnd && *begin == Column::prefix)
+      ++begin;
+  }
+  bool ok = true;
+  if constexpr (Column::field == FIELD_TIME) {
+    ok = parseTime<Column::format>(begin, fieldEnd, candle.time);
+  } else if constexpr (Column::field == FIELD_TIME_OF_DAY) {
+    int64_t seconds;
+    ok = parseTimeOfDay(begin, fieldEnd, seconds);
+    if (ok)
+      candle.time += seconds;
+  } else if constexpr (Column::field != FIELD_SKIP) {
+    auto [ptr, ec] =
+        std::from_chars(begin, fieldEnd, candle.*FIELD_MEMBERS[Column::field]);
+    ok = ec == std::errc() && ptr == fieldEnd;
+  }
+  return ok ? nullptr : FIELD_ERRORS[Column::field];
+}
+
+// Parses one row of a schema. Returns an error message, or nullptr on
+// success.
+template <typename... Columns>
+const char *parseRow(const char *begin, const char *end, Candlestick &candle,
+                     CsvSchema<Columns...>)
+{
+  const char *field = begin;
+  const char *error = nullptr;
+  (((error = parseColumn<Columns>(field, end, candle)) == nullptr) && ...);
+  if (!error && field <= end)
+    return "too many fields";
+  return error;
+}
+
+using NasdaqSchema = CsvSchema<CsvColumn<FIELD_TIME, DATE_MDY>,
+                               CsvColumn<FIELD_CLOSE, VALUE_DECIMAL, '$'>,
+                               CsvColumn<FIELD_VOLUME>,
+                               CsvColumn<FIELD_OPEN, VALUE_DECIMAL, '$'>,
+                               CsvColumn<FIELD_HIGH, VALUE_DECIMAL, '$'>,
+                               CsvColumn<FIELD_LOW, VALUE_DECIMAL, '$'>>;
+
+// Yahoo Finance history, oldest first
+using YahooSchema =
+    CsvSchema<CsvColumn<FIELD_TIME, DATE_YMD>, CsvColumn<FIELD_OPEN>,
+              CsvColumn<FIELD_HIGH>, CsvColumn<FIELD_LOW>,
+              CsvColumn<FIELD_CLOSE>, CsvColumn<FIELD_SKIP>, // Adj Close
+              CsvColumn<FIELD_VOLUME>>;
+
+// Exchange and charting exports keyed by Unix time
+using EpochSchema =
+    CsvSchema<CsvColumn<FIELD_TIME, EPOCH_SECONDS>, CsvColumn<FIELD_OPEN>,
+              CsvColumn<FIELD_HIGH>, CsvColumn<FIELD_LOW>,
+              CsvColumn<FIELD_CLOSE>, CsvColumn<FIELD_VOLUME>>;
+using EpochMillisecondsSchema =
+    CsvSchema<CsvColumn<FIELD_TIME, EPOCH_MILLISECONDS>, CsvColumn<FIELD_OPEN>,
+              CsvColumn<FIELD_HIGH>, CsvColumn<FIELD_LOW>,
+              CsvColumn<FIELD_CLOSE>, CsvColumn<FIELD_VOLUME>>;
+
+// Broker exports with separate date and time columns
+using BrokerSchema =
+    CsvSchema<CsvColumn<FIELD_TIME, DATE_YMD>, CsvColumn<FIELD_TIME_OF_DAY>,
+              CsvColumn<FIELD_OPEN>, CsvColumn<FIELD_HIGH>,
+              CsvColumn<FIELD_LOW>, CsvColumn<FIELD_CLOSE>,
+              CsvColumn<FIELD_VOLUME>>;
+
+// Splits [begin, end) into up to `numChunks` newline-aligned ranges,
+// returned as numChunks + 1 boundaries.
+std::vector<const char *> splitLines(const char *begin, const char *end,
+                                     size_t numChunks)
+{
+  size_t size = static_cast<size_t>(end - begin);
+  std::vector<const char *> bounds{begin};
+  for (size_t i = 1; i < numChunks; ++i) {
+    const char *split = std::max(bounds.back(), begin + size * i / numChunks);
+    const char *newline = static_cast<const char *>(
+        std::memchr(split, '\n', static_cast<size_t>(end - split)));
+    bounds.push_back(newline ? newline + 1 : end);
+  }
+  bounds.push_back(end);
+  return bounds;
+}
+
+struct ParseChunk {
+  std::vector<Candlestick> candles;
+  std::vector<ParseError> errors; // Lines relative to the chunk start
+  size_t numLines = 0;
+};
+
+template <typename Schema>
+void parseChunk(const char *begin, const char *end, ParseChunk &chunk)
+{
+  chunk.candles.reserve((end - begin) / 48);
+  Candlestick candle;
+  while (begin < end) {
+    const char *lineEnd = static_cast<const char *>(
+        std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+    if (!lineEnd)
+      lineEnd = end;
+    const char *contentEnd = lineEnd;
+    if (contentEnd > begin && contentEnd[-1] == '\r')
+      --contentEnd;
+    if (contentEnd > begin) {
+      if (const char *error = parseRow(begin, contentEnd, candle, Schema{}))
+        chunk.errors.push_back({chunk.numLines, error});
+      else
+        chunk.candles.push_back(candle);
+    }
+    ++chunk.numLines;
+    begin = lineEnd + 1;
+  }
+}
+
+template <typename Schema>
+const char *parseSchemaRow(const char *begin, const char *end,
+                           Candlestick &candle)
+{
+  return parseRow(begin, end, candle, Schema{});
+}
+
+// A vendor layout and the header row that identifies it.
+struct CsvFormat {
+  const char *name;
+  const char *header;
+  const char *(*parseRow)(const char *, const char *, Candlestick &);
+  void (*parseChunk)(const char *, const char *, ParseChunk &);
+};
+
+template <typename Schema>
+constexpr CsvFormat csvFormat(const char *name, const char *header)
+{
+  return {name, header, parseSchemaRow<Schema>, parseChunk<Schema>};
+}
+
+using OhlcvSchema =
+    CsvSchema<CsvColumn<FIELD_TIME, DATE_YMD>, CsvColumn<FIELD_OPEN>,
+              CsvColumn<FIELD_HIGH>, CsvColumn<FIELD_LOW>,
+              CsvColumn<FIELD_CLOSE>, CsvColumn<FIELD_VOLUME>>;
+
+// Tried in order when a file's header names none of them
+constexpr CsvFormat CSV_FORMATS[] = {
+    csvFormat<NasdaqSchema>("NASDAQ", "Date,Close/Last,Volume,Open,High,Low"),
+    csvFormat<YahooSchema>("Yahoo",
+                           "Date,Open,High,Low,Close,Adj Close,Volume"),
+    csvFormat<OhlcvSchema>("OHLCV", "Date,Open,High,Low,Close,Volume"),
+    csvFormat<EpochSchema>("TradingView", "time,open,high,low,close,Volume"),
+    csvFormat<EpochMillisecondsSchema>("Unix milliseconds",
+                                       "timestamp,open,high,low,close,volume"),
+    csvFormat<BrokerSchema>("Broker", "Date,Time,Open,High,Low,Close,Volume"),
 };
 
-struct ChartLine {
-  float startCandle, startPrice, endCandle, endPrice;
+// Returns the end of the line starting at `begin`, before any "\r\n".
+const char *lineEnd(const char *begin, const char *end)
+{
+  const char *newline = static_cast<const char *>(
+      std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+  const char *contentEnd = newline ? newline : end;
+  if (contentEnd > begin && contentEnd[-1] == '\r')
+    --contentEnd;
+  return contentEnd;
+}
+
+// Returns the start of the line after the one starting at `begin`.
+const char *nextLine(const char *begin, const char *end)
+{
+  const char *newline = static_cast<const char *>(
+      std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+  return newline ? newline + 1 : end;
+}
+
+bool equalsIgnoreCase(const char *begin, const char *end, const char *text)
+{
+  for (; begin != end; ++begin, ++text) {
+    if (!*text || std::tolower(static_cast<unsigned char>(*begin)) !=
+                      std::tolower(static_cast<unsigned char>(*text)))
+      return false;
+  }
+  return !*text;
+}
+
+// Picks the format of a CSV by its header row, or failing that by the first
+// format its first row parses with. Sets `body` to the first data line.
+const CsvFormat *detectFormat(const char *begin, const char *end,
+                              const char *&body)
+{
+  const char *headerEnd = lineEnd(begin, end);
+  body = nextLine(begin, end);
+  for (const auto &format : CSV_FORMATS) {
+    if (equalsIgnoreCase(begin, headerEnd, format.header))
+      return &format;
+  }
+  Candlestick candle;
+  for (const char *row : {begin, body}) {
+    const char *rowEnd = lineEnd(row, end);
+    for (const auto &format : CSV_FORMATS) {
+      if (!format.parseRow(row, rowEnd, candle)) {
+        if (row == begin)
+          body = begin; // No header
+        return &format;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// Finds the time of the first row in [begin, end) that parses, searching
+// from the front or the back, giving up after a few lines.
+bool edgeRowTime(const CsvFormat &format, const char *begin, const char *end,
+                 bool fromBack, int64_t &time)
+{
+  constexpr int MAX_LINES = 16;
+  Candlestick candle;
+  const char *next = fromBack ? end : begin;
+  for (int i = 0; i < MAX_LINES && next != (fromBack ? begin : end); ++i) {
+    const char *line = next;
+    if (fromBack) {
+      line = next - 1;
+      while (line > begin && line[-1] != '\n')
+        --line;
+      next = line;
+    } else {
+      next = nextLine(line, end);
+    }
+    const char *contentEnd = lineEnd(line, end);
+    if (contentEnd > line && !format.parseRow(line, contentEnd, candle)) {
+      time = candle.time;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Receives the candles parsed so far, newest first, and the fraction of the
+// file they cover.
+using ParseProgress =
+    std::function<void(const std::vector<Candlestick> &, float)>;
+
+// Parses a CSV in any of CSV_FORMATS on all cores and returns its candles
+// oldest first. With a progress callback the file is parsed in rounds from
+// its newest end, the first just large enough to fill a screen and each
+// later one as large as all before it, reporting after every round but the
+// last.
+std::vector<Candlestick> parseData(const std::string &filename,
+                                   ParseStats *stats = nullptr,
+                                   const ParseProgress &progress = {})
+{
+  auto startTime = std::chrono::steady_clock::now();
+  MappedFile file(filename, MADV_SEQUENTIAL);
+  if (!file) {
+    std::cerr << "Failed to open file: " << filename << std::endl;
+    return {};
+  }
+  const char *begin = file.data;
+  const char *end = file.data + file.size;
+  if (file.size >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+    begin += 3; // UTF-8 byte order mark
+
+  const char *body;
+  const CsvFormat *format = detectFormat(begin, end, body);
+  if (!format) {
+    std::cerr << filename << ": unrecognized CSV format" << std::endl;
+    return {};
+  }
+
+  // Rows may run either way; only newest-first files need reversing
+  int64_t firstTime, lastTime;
+  bool newestFirst = edgeRowTime(*format, body, end, false, firstTime) &&
+                     edgeRowTime(*format, body, end, true, lastTime) &&
+                     firstTime > lastTime;
+
+  constexpr size_t FIRST_ROUND_BYTES = 1 << 16;
+  constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+  constexpr size_t MAX_REPORTED_ERRORS = 10;
+  size_t bodySize = static_cast<size_t>(end - body);
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<Candlestick> candles; // In file order, or newest first
+  struct Round {
+    const char *begin;
+    size_t numLines;
+    std::vector<ParseError> errors;
+  };
+  std::vector<Round> rounds;
+  // Progressive rounds grow from the newest end: forwards through
+  // newest-first files and backwards through chronological ones
+  const char *parsedBegin = newestFirst || !progress ? body : end;
+  const char *parsedEnd = newestFirst || !progress ? body : end;
+  while (parsedBegin > body || parsedEnd < end) {
+    const char *roundBegin = parsedEnd < end ? parsedEnd : body;
+    const char *roundEnd = parsedEnd < end ? end : parsedBegin;
+    if (progress) {
+      size_t parsed = static_cast<size_t>(parsedEnd - parsedBegin);
+      size_t roundBytes =
+          std::min(std::max(parsed, FIRST_ROUND_BYTES),
+                   static_cast<size_t>(roundEnd - roundBegin));
+      if (newestFirst) {
+        const char *split = roundBegin + roundBytes;
+        const char *newline = static_cast<const char *>(
+            std::memchr(split, '\n', static_cast<size_t>(end - split)));
+        roundEnd = newline ? newline + 1 : end;
+      } else {
+        const char *split = roundEnd - roundBytes;
+        while (split > body && split[-1] != '\n')
+          --split;
+        roundBegin = split;
+      }
+    }
+
+    // Split into newline-aligned chunks, one per thread
+    size_t roundSize = static_cast<size_t>(roundEnd - roundBegin);
+    size_t numChunks =
+        std::clamp<size_t>(roundSize / MIN_CHUNK_BYTES, 1, maxThreads);
+    std::vector<const char *> bounds =
+        splitLines(roundBegin, roundEnd, numChunks);
+
+    std::vector<ParseChunk> chunks(numChunks);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < numChunks; ++i)
+      workers.emplace_back(format->parseChunk, bounds[i], bounds[i + 1],
+                           std::ref(chunks[i]));
+    format->parseChunk(bounds[0], bounds[1], chunks[0]);
+    for (auto &worker : workers)
+      worker.join();
+
+    // Concatenate in file order, keeping errors until line numbers are known
+    size_t roundCandles = 0;
+    for (const auto &chunk : chunks)
+      roundCandles += chunk.candles.size();
+    size_t oldSize = candles.size();
+    candles.reserve(oldSize + roundCandles);
+    Round &round = rounds.emplace_back(Round{roundBegin, 0, {}});
+    for (auto &chunk : chunks) {
+      for (const auto &error : chunk.errors)
+        round.errors.push_back({round.numLines + error.line, error.message});
+      std::move(chunk.candles.begin(), chunk.candles.end(),
+                std::back_inserter(candles));
+      round.numLines += chunk.numLines;
+    }
+    if (progress && !newestFirst)
+      std::reverse(candles.begin() + oldSize, candles.end());
+    parsedBegin = std::min(parsedBegin, roundBegin);
+    parsedEnd = std::max(parsedEnd, roundEnd);
+    if (progress && (parsedBegin > body || parsedEnd < end))
+      progress(candles, static_cast<float>(parsedEnd - parsedBegin) /
+                            bodySize);
+  }
+  if (newestFirst || progress)
+    std::reverse(candles.begin(), candles.end());
+
+  std::sort(rounds.begin(), rounds.end(),
+            [](const Round &a, const Round &b) { return a.begin < b.begin; });
+  size_t totalErrors = 0;
+  size_t firstLine = body == begin ? 1 : 2; // Line 1 may be the header
+  for (const auto &round : rounds) {
+    for (const auto &error : round.errors) {
+      if (totalErrors++ < MAX_REPORTED_ERRORS)
+        std::cerr << filename << ":" << firstLine + error.line << ": "
+                  << error.message << std::endl;
+    }
+    firstLine += round.numLines;
+  }
+  if (totalErrors > MAX_REPORTED_ERRORS)
+    std::cerr << filename << ": " << totalErrors - MAX_REPORTED_ERRORS
+              << " more malformed lines skipped" << std::endl;
+
+  if (stats) {
+    stats->bytes = file.size;
+    stats->rows = candles.size();
+    stats->errors = totalErrors;
+    stats->seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count();
+  }
+  return candles;
+}
+
+// Binary cache written next to the CSV: a header followed by fixed-width,
+// 64-byte aligned columns in chronological order, then the pyramid levels
+// from CACHE_FIRST_LEVEL up, each laid out like the base columns. Series
+// too large to hold in memory are drawn from the stored levels.
+constexpr char CACHE_MAGIC[8] = {'C', 'N', 'D', 'L', 'B', 'I', 'N', 0};
+constexpr uint32_t CACHE_VERSION = 3;
+constexpr size_t CACHE_ALIGNMENT = 64;
+// Levels below merge at most 8 candles, few enough to draw from the base
+constexpr size_t CACHE_FIRST_LEVEL = 4;
+
+enum CacheColumn {
+  CACHE_OPEN,
+  CACHE_HIGH,
+  CACHE_LOW,
+  CACHE_CLOSE,
+  CACHE_VOLUME,
+  CACHE_TIME,
+  NUM_CACHE_COLUMNS
+};
+
+enum CachePriceFormat : uint32_t { PRICE_FLOAT32, PRICE_INT32_TICKS };
+
+constexpr CachePriceFormat NATIVE_PRICE_FORMAT =
+    std::is_same_v<Price, float> ? PRICE_FLOAT32 : PRICE_INT32_TICKS;
+
+constexpr size_t CACHE_COLUMN_WIDTHS[NUM_CACHE_COLUMNS] = {
+    sizeof(Price), sizeof(Price), sizeof(Price),
+    sizeof(Price), sizeof(float), sizeof(int64_t)};
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t numCandles;
+  uint64_t sourceSize;  // CSV size in bytes when the cache was written
+  int64_t sourceMtime;  // CSV modification time when the cache was written
+  uint32_t priceFormat; // CachePriceFormat
+  uint32_t firstLevel;  // CACHE_FIRST_LEVEL when written
+  double priceTick;     // Tick size for PRICE_INT32_TICKS
+  uint64_t columnOffsets[NUM_CACHE_COLUMNS];
+  uint64_t levelsOffset; // Start of the first stored pyramid level
+};
+
+// Lays out the columns of `count` candles from `offset`, each aligned to
+// CACHE_ALIGNMENT. Returns the end of the last column.
+size_t layoutCacheColumns(size_t offset, size_t count,
+                          uint64_t offsets[NUM_CACHE_COLUMNS])
+{
+  for (int c = 0; c < NUM_CACHE_COLUMNS; ++c) {
+    offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+    offsets[c] = offset;
+    offset += CACHE_COLUMN_WIDTHS[c] * count;
+  }
+  return offset;
+}
+
+// Size of pyramid level `level` (merging 2^level candles) of `size` base
+// candles, or 0 past the top level, as built by updateCandlePyramid.
+size_t pyramidLevelSize(size_t size, size_t level)
+{
+  if (level >= 64 || size <= (size_t(1) << (level - 1)))
+    return 0;
+  return (size - 1) / (size_t(1) << level) + 1;
+}
+
+// Merges every `factor` consecutive candles of `source` into one.
+CandleSeries mergeCandles(const CandleSeries &source, size_t factor)
+{
+  size_t size = (source.size() + factor - 1) / factor;
+  CandleSeries merged;
+  merged.resize(size);
+  for (size_t j = 0; j < size; ++j) {
+    size_t a = j * factor, b = std::min(a + factor, source.size()) - 1;
+    merged.open[j] = source.open[a];
+    merged.close[j] = source.close[b];
+    columnMinMax(source.low.data, source.high.data, a, b, merged.low[j],
+                 merged.high[j]);
+    float volume = 0.f;
+    for (size_t i = a; i <= b; ++i)
+      volume += source.volume[i];
+    merged.volume[j] = volume;
+    merged.time[j] = source.time[a];
+  }
+  return merged;
+}
+
+struct SourceInfo {
+  uint64_t size = 0;
+  int64_t mtime = 0;
+};
+
+bool statSource(const std::string &filename, SourceInfo &source)
+{
+  std::error_code ec;
+  auto size = std::filesystem::file_size(filename, ec);
+  if (ec)
+    return false;
+  auto mtime = std::filesystem::last_write_time(filename, ec);
+  if (ec)
+    return false;
+  source.size = size;
+  source.mtime = mtime.time_since_epoch().count();
+  return true;
+}
+
+// Writes to a temporary file and renames it so readers never see a partial
+// cache.
+bool writeCandleCache(const std::string &filename, const CandleSeries &series,
+                      const SourceInfo &source)
+{
+  CacheHeader header{};
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.headerSize = sizeof(CacheHeader);
+  header.numCandles = series.size();
+  header.sourceSize = source.size;
+  header.sourceMtime = source.mtime;
+  header.priceFormat = NATIVE_PRICE_FORMAT;
+  header.firstLevel = CACHE_FIRST_LEVEL;
+  header.priceTick = PRICE_TICK;
+  header.levelsOffset = layoutCacheColumns(sizeof(CacheHeader), series.size(),
+                                           header.columnOffsets);
+
+  std::string tempName = filename + ".tmp";
+  {
+    std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    size_t written = sizeof(header);
+    auto writeColumns = [&](const CandleSeries &candles,
+                            const uint64_t offsets[NUM_CACHE_COLUMNS]) {
+      const void *columns[NUM_CACHE_COLUMNS] = {
+          candles.open.data,  candles.high.data,   candles.low.data,
+          candles.close.data, candles.volume.data, candles.time.data};
+      for (int c = 0; c < NUM_CACHE_COLUMNS && out; ++c) {
+        static const char PADDING[CACHE_ALIGNMENT] = {};
+        out.write(PADDING,
+                  static_cast<std::streamsize>(offsets[c] - written));
+        size_t bytes = CACHE_COLUMN_WIDTHS[c] * candles.size();
+        out.write(static_cast<const char *>(columns[c]),
+                  static_cast<std::streamsize>(bytes));
+        written = offsets[c] + bytes;
+      }
+    };
+    writeColumns(series, header.columnOffsets);
+
+    // Each level is merged from the one below, so only two are held at once
+    CandleSeries level;
+    uint64_t offsets[NUM_CACHE_COLUMNS];
+    size_t offset = header.levelsOffset;
+    for (size_t l = CACHE_FIRST_LEVEL;
+         pyramidLevelSize(series.size(), l) && out; ++l) {
+      level = l == CACHE_FIRST_LEVEL
+                  ? mergeCandles(series, size_t(1) << CACHE_FIRST_LEVEL)
+                  : mergeCandles(level, 2);
+      offset = layoutCacheColumns(offset, level.size(), offsets);
+      writeColumns(level, offsets);
+    }
+    if (!out.flush())
+      return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tempName, filename, ec);
+  if (ec)
+    std::filesystem::remove(tempName, ec);
+  return !ec;
+}
+
+// Points the columns of `candles` at a table of `count` candles laid out by
+// layoutCacheColumns in a mapped cache.
+void borrowCacheColumns(const char *data,
+                        const uint64_t offsets[NUM_CACHE_COLUMNS],
+                        size_t count, CandleSeries &candles)
+{
+  auto column = [&](CacheColumn c) { return data + offsets[c]; };
+  candles.open.borrow(reinterpret_cast<const Price *>(column(CACHE_OPEN)),
+                      count);
+  candles.high.borrow(reinterpret_cast<const Price *>(column(CACHE_HIGH)),
+                      count);
+  candles.low.borrow(reinterpret_cast<const Price *>(column(CACHE_LOW)),
+                     count);
+  candles.close.borrow(reinterpret_cast<const Price *>(column(CACHE_CLOSE)),
+                       count);
+  candles.volume.borrow(reinterpret_cast<const float *>(column(CACHE_VOLUME)),
+                        count);
+  candles.time.borrow(reinterpret_cast<const int64_t *>(column(CACHE_TIME)),
+                      count);
+}
+
+// Maps a cache file and, if it is valid for the source CSV, points the
+// series' columns into the mapping. Nothing is copied.
+bool mapCandleCache(const std::string &filename, const SourceInfo &source,
+                    CandleSeries &series)
+{
+  MappedFile mapping(filename);
+  CacheHeader header;
+  if (!mapping || mapping.size < sizeof(header))
+    return false;
+  std::memcpy(&header, mapping.data, sizeof(header));
+  if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header.version != CACHE_VERSION ||
+      header.headerSize != sizeof(CacheHeader) ||
+      header.sourceSize != source.size || header.sourceMtime != source.mtime ||
+      header.priceFormat != NATIVE_PRICE_FORMAT ||
+      header.priceTick != PRICE_TICK ||
+      header.firstLevel != CACHE_FIRST_LEVEL)
+    return false;
+  for (int c = 0; c < NUM_CACHE_COLUMNS; ++c) {
+    if (header.columnOffsets[c] % CACHE_ALIGNMENT != 0 ||
+        header.columnOffsets[c] > mapping.size ||
+        (mapping.size - header.columnOffsets[c]) / CACHE_COLUMN_WIDTHS[c] <
+            header.numCandles)
+      return false;
+  }
+  size_t n = header.numCandles;
+  size_t levelsEnd = header.levelsOffset;
+  uint64_t offsets[NUM_CACHE_COLUMNS];
+  for (size_t l = CACHE_FIRST_LEVEL;
+       pyramidLevelSize(n, l) && levelsEnd <= mapping.size; ++l)
+    levelsEnd = layoutCacheColumns(levelsEnd, pyramidLevelSize(n, l), offsets);
+  if (levelsEnd > mapping.size)
+    return false;
+  borrowCacheColumns(mapping.data, header.columnOffsets, n, series);
+  series.mapping = std::move(mapping);
+  return true;
+}
+
+// Points the levels of `pyramid` from CACHE_FIRST_LEVEL up at those stored
+// in the cache mapped by `series`; finer levels are left empty. Returns
+// false if the series is not mapped from a cache.
+bool mapCachePyramid(const CandleSeries &series, CandlePyramid &pyramid)
+{
+  const MappedFile &mapping = series.mapping;
+  if (!mapping || mapping.size < sizeof(CacheHeader))
+    return false;
+  CacheHeader header;
+  std::memcpy(&header, mapping.data, sizeof(header));
+  pyramid = {};
+  uint64_t offsets[NUM_CACHE_COLUMNS];
+  size_t offset = header.levelsOffset;
+  for (size_t l = 1; size_t size = pyramidLevelSize(series.size(), l); ++l) {
+    CandleSeries &level = pyramid.levels.emplace_back();
+    if (l < CACHE_FIRST_LEVEL)
+      continue;
+    offset = layoutCacheColumns(offset, size, offsets);
+    borrowCacheColumns(mapping.data, offsets, size, level);
+  }
+  pyramid.baseSize = series.size();
+  return true;
+}
+
+// Loads a CSV through its binary cache, parsing the CSV and
+// (re)writing the cache only when the CSV's size or mtime changed.
+// `progress` follows a parse; a cache loads at once.
+CandleSeries loadCandles(const std::string &filename,
+                         ParseStats *stats = nullptr,
+                         const ParseProgress &progress = {})
+{
+  CandleSeries series;
+  SourceInfo source;
+  if (!statSource(filename, source)) {
+    std::cerr << "Failed to open file: " << filename << std::endl;
+    return series;
+  }
+  std::string cacheName = filename + ".cache";
+  if (mapCandleCache(cacheName, source, series)) {
+    if (stats)
+      stats->fromCache = true;
+    return series;
+  }
+
+  auto candles = parseData(filename, stats, progress);
+  series.reserve(candles.size());
+  for (const auto &candle : candles)
+    series.append(candle);
+  candles = {};
+  if (!writeCandleCache(cacheName, series, source))
+    std::cerr << "Failed to write cache: " << cacheName << std::endl;
+  else if (CandleSeries mapped; mapCandleCache(cacheName, source, mapped))
+    return mapped;
+  return series;
+}
+
+// A trade print. Times are nanoseconds since the epoch.
+struct Tick {
+  int64_t time;
+  float price;
+  float size;
+};
+
+constexpr int64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+// Binary tick files are TICK_MAGIC followed by packed Tick records; anything
+// else is read as "timestamp,price,size" CSV with epoch-second timestamps
+// and an optional fraction.
+constexpr char TICK_MAGIC[8] = {'C', 'N', 'D', 'L', 'T', 'C', 'K', 0};
+
+bool parseTick(const char *begin, const char *end, Tick &tick)
+{
+  const char *comma = std::find(begin, end, ',');
+  int64_t seconds = 0, fraction = 0;
+  auto r = std::from_chars(begin, comma, seconds);
+  if (r.ec != std::errc())
+    return false;
+  int64_t scale = NANOSECONDS_PER_SECOND;
+  if (r.ptr != comma && *r.ptr == '.') {
+    for (const char *c = r.ptr + 1; c != comma; ++c) {
+      if (*c < '0' || *c > '9')
+        return false;
+      if (scale > 1) {
+        scale /= 10;
+        fraction += (*c - '0') * scale;
+      }
+    }
+  } else if (r.ptr != comma) {
+    return false;
+  }
+  tick.time = seconds * NANOSECONDS_PER_SECOND + fraction;
+  if (comma == end)
+    return false;
+  const char *sizeField = std::find(comma + 1, end, ',');
+  return sizeField != end && parseNumber(comma + 1, sizeField, tick.price) &&
+         parseNumber(sizeField + 1, end, tick.size);
+}
+
+struct TickFile {
+  MappedFile mapping;
+  const char *begin = nullptr, *end = nullptr; // Records or CSV rows
+  bool binary = false;
+};
+
+bool openTickFile(const std::string &filename, TickFile &file, int advice)
+{
+  file.mapping = MappedFile(filename, advice);
+  if (!file.mapping)
+    return false;
+  file.begin = file.mapping.data;
+  file.end = file.mapping.data + file.mapping.size;
+  file.binary = file.mapping.size >= sizeof(TICK_MAGIC) &&
+                std::memcmp(file.begin, TICK_MAGIC, sizeof(TICK_MAGIC)) == 0;
+  if (file.binary) {
+    file.begin += sizeof(TICK_MAGIC);
+    file.end = file.begin + (file.end - file.begin) / sizeof(Tick) *
+                                sizeof(Tick);
+  } else if (file.begin != file.end &&
+             !(std::isdigit(static_cast<unsigned char>(*file.begin)))) {
+    // Skip header
+    const char *newline = static_cast<const char *>(
+        std::memchr(file.begin, '\n', file.mapping.size));
+    file.begin = newline ? newline + 1 : file.end;
+  }
+  return true;
+}
+
+struct TickReader {
+  const char *cursor, *end;
+  bool binary;
+  size_t numTicks = 0, errors = 0;
+};
+
+inline bool nextTick(TickReader &reader, Tick &tick)
+{
+  if (reader.binary) {
+    if (reader.cursor == reader.end)
+      return false;
+    std::memcpy(&tick, reader.cursor, sizeof(Tick));
+    reader.cursor += sizeof(Tick);
+    ++reader.numTicks;
+    return true;
+  }
+  while (reader.cursor < reader.end) {
+    const char *lineEnd = static_cast<const char *>(std::memchr(
+        reader.cursor, '\n', static_cast<size_t>(reader.end - reader.cursor)));
+    if (!lineEnd)
+      lineEnd = reader.end;
+    const char *begin = reader.cursor;
+    const char *contentEnd = lineEnd;
+    if (contentEnd > begin && contentEnd[-1] == '\r')
+      --contentEnd;
+    reader.cursor = lineEnd + 1;
+    if (contentEnd == begin)
+      continue;
+    if (parseTick(begin, contentEnd, tick)) {
+      ++reader.numTicks;
+      return true;
+    }
+    ++reader.errors;
+  }
+  reader.cursor = reader.end;
+  return false;
+}
+
+// Parses a bar interval such as "1s", "5m", "1h" or "1d" into seconds.
+bool parseInterval(const std::string &text, int64_t &seconds)
+{
+  int64_t count = 0;
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), count);
+  if (ec != std::errc() || count <= 0 || ptr + 1 != text.data() + text.size())
+    return false;
+  switch (*ptr) {
+  case 's': seconds = count; return true;
+  case 'm': seconds = count * 60; return true;
+  case 'h': seconds = count * 3600; return true;
+  case 'd': seconds = count * SECONDS_PER_DAY; return true;
+  }
+  return false;
+}
+
+// Rolls ticks into fixed-interval bars. Bars start on multiples of the
+// interval since the epoch; late ticks fold into the current bar.
+struct BarAggregator {
+  int64_t interval;    // Nanoseconds per bar
+  int64_t barEnd = 0;  // Exclusive, in nanoseconds
+  Candlestick bar{};
+  bool hasBar = false;
+};
+
+// Adds a tick to the current bar. Returns true if the tick opened a new bar,
+// with the completed one in `finished`.
+inline bool addTick(BarAggregator &aggregator, const Tick &tick,
+                    Candlestick &finished)
+{
+  Candlestick &bar = aggregator.bar;
+  if (aggregator.hasBar && tick.time < aggregator.barEnd) {
+    bar.high = std::max(bar.high, tick.price);
+    bar.low = std::min(bar.low, tick.price);
+    bar.close = tick.price;
+    bar.volume += tick.size;
+    return false;
+  }
+  finished = bar;
+  bool closed = aggregator.hasBar;
+  int64_t offset = tick.time % aggregator.interval;
+  int64_t start = tick.time - (offset < 0 ? offset + aggregator.interval
+                                          : offset);
+  aggregator.barEnd = start + aggregator.interval;
+  bar = {tick.price, tick.price,  tick.price,
+         tick.price, tick.size,   start / NANOSECONDS_PER_SECOND};
+  aggregator.hasBar = true;
+  return closed;
+}
+
+void aggregateTicks(TickReader &reader, int64_t interval, CandleSeries &bars)
+{
+  BarAggregator aggregator{interval * NANOSECONDS_PER_SECOND};
+  Tick tick;
+  Candlestick finished;
+  while (nextTick(reader, tick)) {
+    if (addTick(aggregator, tick, finished))
+      bars.append(finished);
+  }
+  if (aggregator.hasBar)
+    bars.append(aggregator.bar);
+}
+
+// Aggregates a historical tick file into bars of `interval` seconds. With
+// several threads the file is split into contiguous time ranges whose
+// boundary bars are merged afterwards.
+CandleSeries aggregateTickFile(const std::string &filename, int64_t interval,
+                               size_t numThreads, ParseStats *stats = nullptr)
+{
+  auto startTime = std::chrono::steady_clock::now();
+  CandleSeries series;
+  TickFile file;
+  if (!openTickFile(filename, file, MADV_SEQUENTIAL)) {
+    std::cerr << "Failed to open file: " << filename << std::endl;
+    return series;
+  }
+
+  std::vector<const char *> bounds;
+  if (file.binary) {
+    size_t count = static_cast<size_t>(file.end - file.begin) / sizeof(Tick);
+    numThreads = std::clamp<size_t>(numThreads, 1, std::max<size_t>(count, 1));
+    for (size_t i = 0; i <= numThreads; ++i)
+      bounds.push_back(file.begin + count * i / numThreads * sizeof(Tick));
+    // Reserve for the worst case of one bar per tick or per interval
+    Tick first, last;
+    if (count) {
+      std::memcpy(&first, file.begin, sizeof(Tick));
+      std::memcpy(&last, file.end - sizeof(Tick), sizeof(Tick));
+      int64_t span = (last.time - first.time) /
+                     (interval * NANOSECONDS_PER_SECOND);
+      series.reserve(std::min<size_t>(count, std::max<int64_t>(span, 0) + 2));
+    }
+  } else {
+    bounds = splitLines(file.begin, file.end, std::max<size_t>(numThreads, 1));
+  }
+
+  size_t numParts = bounds.size() - 1;
+  std::vector<CandleSeries> parts(numParts);
+  std::vector<TickReader> readers;
+  for (size_t i = 0; i < numParts; ++i)
+    readers.push_back({bounds[i], bounds[i + 1], file.binary});
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < numParts; ++i)
+    workers.emplace_back(aggregateTicks, std::ref(readers[i]), interval,
+                         std::ref(parts[i]));
+  aggregateTicks(readers[0], interval, numParts == 1 ? series : parts[0]);
+  for (auto &worker : workers)
+    worker.join();
+
+  // Concatenate parts, merging bars split across a boundary
+  size_t numTicks = 0, errors = 0;
+  for (size_t i = 0; i < numParts; ++i) {
+    numTicks += readers[i].numTicks;
+    errors += readers[i].errors;
+    if (numParts == 1)
+      break;
+    const CandleSeries &part = parts[i];
+    size_t first = 0;
+    if (!series.empty() && !part.empty() &&
+        part.time[0] == series.time[series.size() - 1]) {
+      Candlestick merged = series.at(series.size() - 1);
+      Candlestick next = part.at(0);
+      merged.high = std::max(merged.high, next.high);
+      merged.low = std::min(merged.low, next.low);
+      merged.close = next.close;
+      merged.volume += next.volume;
+      series.set(series.size() - 1, merged);
+      first = 1;
+    }
+    series.reserve(series.size() + part.size() - first);
+    for (size_t j = first; j < part.size(); ++j)
+      series.append(part.at(j));
+  }
+  if (errors)
+    std::cerr << filename << ": " << errors << " malformed ticks skipped"
+              << std::endl;
+
+  if (stats) {
+    stats->bytes = file.mapping.size;
+    stats->rows = numTicks;
+    stats->errors = errors;
+    stats->seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count();
+  }
+  return series;
+}
+
+// Writes `count` random-walk ticks, 10 ms apart starting now, as a binary
+// tick file for testing --ticks and --replay.
+int writeSimulatedTicks(const std::string &filename, size_t count)
+{
+  std::ofstream out(filename, std::ios::binary);
+  out.write(TICK_MAGIC, sizeof(TICK_MAGIC));
+  std::mt19937 rng(std::random_device{}());
+  std::normal_distribution<float> step(0.f, 0.0005f);
+  std::uniform_int_distribution<int> size(1, 500);
+  Tick tick{std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count(),
+            100.f, 0.f};
+  constexpr int64_t TICK_SPACING = NANOSECONDS_PER_SECOND / 100;
+  for (size_t i = 0; i < count && out; ++i) {
+    tick.price = std::max(0.01f, tick.price * (1.f + step(rng)));
+    tick.size = static_cast<float>(size(rng));
+    out.write(reinterpret_cast<const char *>(&tick), sizeof(Tick));
+    tick.time += TICK_SPACING;
+  }
+  if (!out.flush()) {
+    std::cerr << "Failed to write ticks: " << filename << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Lock-free single-producer/single-consumer ring buffer.
+template <typename T> struct SpscQueue {
+  std::vector<T> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0}; // Next slot to read
+  alignas(64) std::atomic<size_t> tail{0}; // Next slot to write
+
+  explicit SpscQueue(size_t capacity)
+      : slots(std::bit_ceil(capacity)), mask(slots.size() - 1)
+  {
+  }
+
+  bool push(const T &value)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size())
+      return false;
+    slots[t & mask] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+  bool pop(T &value)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    value = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+struct LiveBar {
+  Candlestick candle;
+  std::chrono::steady_clock::time_point received;
+};
+
+// Bars parsed on a background thread from an append-only CSV, stdin or a
+// local TCP socket, handed to the render loop through an SPSC queue.
+struct LiveFeed {
+  static constexpr size_t QUEUE_CAPACITY = 1 << 16;
+
+  SpscQueue<LiveBar> queue{QUEUE_CAPACITY};
+  std::atomic<bool> stop{false};
+  std::thread reader;
+
+  // Ingest-to-frame latency, measured by the render loop
+  size_t numBars = 0;
+  double totalLatencyUs = 0.0, maxLatencyUs = 0.0;
+
+  ~LiveFeed()
+  {
+    stop = true;
+    if (reader.joinable())
+      reader.join();
+  }
+};
+
+// Queues a bar for the render loop, waiting while the queue is full.
+// Returns false if the feed was stopped meanwhile.
+bool pushLiveBar(LiveFeed &feed, const Candlestick &candle)
+{
+  LiveBar bar{candle, std::chrono::steady_clock::now()};
+  while (!feed.queue.push(bar)) {
+    if (feed.stop.load(std::memory_order_relaxed))
+      return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+void readLiveFeed(LiveFeed &feed, std::string source, int fd, int listenFd)
+{
+  struct stat st;
+  bool isFile = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  std::string pending;
+  std::vector<char> buffer(1 << 16);
+  size_t lineNumber = 0;
+  const CsvFormat *format = nullptr; // Detected from the first line
+  while (!feed.stop.load(std::memory_order_relaxed)) {
+    if (fd < 0) { // Waiting for the next connection
+      pollfd listener{listenFd, POLLIN, 0};
+      if (::poll(&listener, 1, 100) > 0)
+        fd = ::accept(listenFd, nullptr, nullptr);
+      continue;
+    }
+    pollfd input{fd, POLLIN, 0};
+    if (::poll(&input, 1, 100) <= 0)
+      continue;
+    ssize_t n = ::read(fd, buffer.data(), buffer.size());
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (n == 0 && isFile) {
+      // At the end of a growing file; start over if it was truncated
+      if (::fstat(fd, &st) == 0 && st.st_size < ::lseek(fd, 0, SEEK_CUR)) {
+        ::lseek(fd, 0, SEEK_SET);
+        pending.clear();
+        format = nullptr;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+      continue;
+    }
+    if (n <= 0) {
+      if (listenFd < 0)
+        break;
+      ::close(fd); // Connection closed, wait for the next one
+      fd = -1;
+      pending.clear();
+      format = nullptr;
+      continue;
+    }
+
+    pending.append(buffer.data(), static_cast<size_t>(n));
+    size_t lineStart = 0;
+    for (size_t newline; (newline = pending.find('\n', lineStart)) !=
+                         std::string::npos;
+         lineStart = newline + 1) {
+      ++lineNumber;
+      const char *begin = pending.data() + lineStart;
+      const char *end = pending.data() + newline;
+      if (end > begin && end[-1] == '\r')
+        --end;
+      if (end == begin)
+        continue;
+      if (!format) {
+        const char *body;
+        format = detectFormat(begin, end, body);
+        if (!format) {
+          std::cerr << source << ":" << lineNumber
+                    << ": Unrecognized CSV format" << std::endl;
+          continue;
+        }
+        if (body != begin) // Header
+          continue;
+      }
+      Candlestick candle;
+      if (const char *error = format->parseRow(begin, end, candle)) {
+        std::cerr << source << ":" << lineNumber << ": " << error
+                  << std::endl;
+        continue;
+      }
+      if (!pushLiveBar(feed, candle))
+        break; // Stopped
+    }
+    pending.erase(0, lineStart);
+  }
+  if (fd > STDIN_FILENO)
+    ::close(fd);
+  if (listenFd >= 0)
+    ::close(listenFd);
+}
+
+// Starts following `source`: "-" for stdin, "tcp:PORT" to accept
+// connections on localhost, or a file whose new lines are read as they are
+// appended.
+bool startLiveFeed(LiveFeed &feed, const std::string &source)
+{
+  int fd = -1, listenFd = -1;
+  if (source == "-") {
+    fd = STDIN_FILENO;
+  } else if (source.rfind("tcp:", 0) == 0) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(std::atoi(source.c_str() + 4)));
+    listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (listenFd < 0 ||
+        ::bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(listenFd, 1) != 0) {
+      std::cerr << "Failed to listen on " << source << std::endl;
+      if (listenFd >= 0)
+        ::close(listenFd);
+      return false;
+    }
+  } else {
+    fd = ::open(source.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Failed to open file: " << source << std::endl;
+      return false;
+    }
+    ::lseek(fd, 0, SEEK_END);
+  }
+  feed.reader = std::thread(readLiveFeed, std::ref(feed), source, fd, listenFd);
+  return true;
+}
+
+// Replays recorded ticks at `speed` times their original pace, publishing
+// the current bar whenever the replay sleeps or a bar completes. The tick
+// file must outlive the feed.
+void replayTicks(LiveFeed &feed, TickReader reader,
+                 BarAggregator aggregator, double speed)
+{
+  auto start = std::chrono::steady_clock::now();
+  int64_t firstTime = aggregator.barEnd - aggregator.interval;
+  bool published = true;
+  Tick tick;
+  Candlestick finished;
+  while (!feed.stop.load(std::memory_order_relaxed) &&
+         nextTick(reader, tick)) {
+    auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(
+                           (tick.time - firstTime) / speed));
+    if (due - std::chrono::steady_clock::now() >
+        std::chrono::microseconds(200)) {
+      if (!published && !pushLiveBar(feed, aggregator.bar))
+        return;
+      published = true;
+      std::this_thread::sleep_until(due);
+    }
+    if (addTick(aggregator, tick, finished) && !pushLiveBar(feed, finished))
+      return;
+    published = false;
+  }
+  if (!published)
+    pushLiveBar(feed, aggregator.bar);
+}
+
+void stopLiveFeed(LiveFeed &feed)
+{
+  feed.stop = true;
+  if (feed.reader.joinable())
+    feed.reader.join();
+}
+
+// Writes random-walk NASDAQ rows to stdout at a fixed rate, one trading
+// day per bar starting today, for testing --follow.
+int runFeedSimulator(double barsPerSecond)
+{
+  if (barsPerSecond <= 0.0) {
+    std::cerr << "Feed rate must be positive" << std::endl;
+    return 1;
+  }
+  std::mt19937 rng(std::random_device{}());
+  std::normal_distribution<float> step(0.f, 0.01f);
+  std::uniform_real_distribution<float> range(0.f, 0.01f);
+  std::uniform_int_distribution<int> volume(1000000, 90000000);
+  int64_t day = std::chrono::duration_cast<std::chrono::days>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+  float price = 100.f;
+  size_t emitted = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::printf("Date,Close/Last,Volume,Open,High,Low\n");
+  while (true) {
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    size_t due = static_cast<size_t>(elapsed * barsPerSecond);
+    for (; emitted < due; ++emitted, ++day) {
+      float open = price;
+      float close = std::max(0.01f, open * (1.f + step(rng)));
+      float high = std::max(open, close) * (1.f + range(rng));
+      float low = std::min(open, close) * (1.f - range(rng));
+      price = close;
+      std::string date = formatDate(day * SECONDS_PER_DAY);
+      std::printf("%s,$%.2f,%d,$%.2f,$%.2f,$%.2f\n", date.c_str(), close,
+                  volume(rng), open, high, low);
+    }
+    if (std::fflush(stdout) != 0)
+      return 0; // Reader went away
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+}
+
+// Writes an axis-aligned quad as two triangles.
+void setQuad(sf::Vertex *quad, float left, float top, float right,
+             float bottom, sf::Color color)
+{
+  quad[0] = {{left, top}, color};
+  quad[1] = {{right, top}, color};
+  quad[2] = {{right, bottom}, color};
+  quad[3] = {{left, top}, color};
+  quad[4] = {{right, bottom}, color};
+  quad[5] = {{left, bottom}, color};
+}
+
+// y = chartTop + (viewMaxPrice - price) / range * chartHeight, folded into
+// one multiply-add per price.
+void pricesToY(const Price *prices, size_t count, float *ys, float scale,
+               float offset)
+{
+  for (size_t i = 0; i < count; ++i)
+    ys[i] = offset - fromPrice(prices[i]) * scale;
+}
+
+// Candle geometry for the visible range in one vertex array: all wicks,
+// then green bodies, then red bodies. Rebuilt only when the view or the
+// series changes.
+struct CandleBatch {
+  sf::VertexArray vertices{sf::PrimitiveType::Triangles};
+  std::vector<Price> prices;  // Open, high, low and close of the drawn bars
+  std::vector<size_t> starts; // First base candle of each drawn bar
+  std::vector<float> ys;
+  const CandleSeries *series = nullptr;
+  uint64_t revision = 0;
+  std::array<float, 9> layout{};
+};
+
+// Draws the visible candles. When several candles share a pixel column the
+// bars come from the coarsest pyramid level giving at most one bar per
+// column; bars cut by the view edges are merged from the base series so
+// the drawn envelope is exactly that of the visible candles.
+void drawCandlesticks(sf::RenderTarget &target, CandleBatch &batch,
+                      const CandleSeries &candles,
+                      const CandlePyramid &pyramid, float viewStart,
+                      float viewEnd, float marginX, float chartTop,
+                      float chartHeight, float candleWidth, float spacing,
+                      float viewMinPrice, float viewMaxPrice)
+{
+  std::array<float, 9> layout = {viewStart,   viewEnd,      marginX,
+                                 chartTop,    chartHeight,  candleWidth,
+                                 spacing,     viewMinPrice, viewMaxPrice};
+  if (batch.series != &candles || batch.revision != candles.revision ||
+      batch.layout != layout) {
+    batch.series = &candles;
+    batch.revision = candles.revision;
+    batch.layout = layout;
+
+    // Pick the level of detail, skipping levels a paged series leaves out
+    size_t first = static_cast<size_t>(viewStart);
+    size_t last = static_cast<size_t>(viewEnd);
+    float barWidth = candleWidth + spacing;
+    size_t level = 0, factor = 1;
+    for (size_t l = 1; pyramid.baseSize == candles.size() &&
+                       l <= pyramid.levels.size() &&
+                       (size_t(1) << (l - 1)) * barWidth < 1.f;
+         ++l) {
+      if (!pyramid.levels[l - 1].empty()) {
+        level = l;
+        factor = size_t(1) << l;
+      }
+    }
+    const CandleSeries &source = level ? pyramid.levels[level - 1] : candles;
+
+    // Gather the bars to draw
+    size_t count = last / factor - first / factor + 1;
+    batch.prices.resize(4 * count);
+    batch.starts.resize(count + 1);
+    Price *open = batch.prices.data(), *high = open + count,
+          *low = high + count, *close = low + count;
+    for (size_t k = 0; k < count; ++k) {
+      size_t j = first / factor + k;
+      size_t lo = std::max(first, j * factor);
+      size_t hi = std::min(last, j * factor + factor - 1);
+      batch.starts[k] = lo;
+      if (lo == j * factor && hi + 1 == (j + 1) * factor) {
+        open[k] = source.open[j];
+        high[k] = source.high[j];
+        low[k] = source.low[j];
+        close[k] = source.close[j];
+      } else {
+        open[k] = candles.open[lo];
+        close[k] = candles.close[hi];
+        columnMinMax(candles.low.data, candles.high.data, lo, hi, low[k],
+                     high[k]);
+      }
+    }
+    batch.starts[count] = last + 1;
+
+    float scale = chartHeight / (viewMaxPrice - viewMinPrice);
+    float offset = chartTop + viewMaxPrice * scale;
+    batch.ys.resize(4 * count);
+    float *highY = batch.ys.data(), *lowY = highY + count,
+          *openY = lowY + count, *closeY = openY + count;
+    pricesToY(high, count, highY, scale, offset);
+    pricesToY(low, count, lowY, scale, offset);
+    pricesToY(open, count, openY, scale, offset);
+    pricesToY(close, count, closeY, scale, offset);
+
+    batch.vertices.resize(12 * count);
+    sf::Vertex *wicks = &batch.vertices[0];
+    sf::Vertex *green = wicks + 6 * count;
+    sf::Vertex *red = green + 6 * count;
+    for (size_t k = 0; k < count; ++k) {
+      float x = marginX + ((batch.starts[k] - viewStart) * barWidth);
+      float bodyWidth = (batch.starts[k + 1] - batch.starts[k]) * candleWidth;
+      float wickX = x + bodyWidth / 2;
+      setQuad(wicks + 6 * k, wickX, highY[k], wickX + 1, lowY[k],
+              sf::Color::Black);
+      float top = std::min(openY[k], closeY[k]);
+      float bottom = std::max(openY[k], closeY[k]);
+      if (close[k] >= open[k]) {
+        setQuad(green, x + 0.5f, top, x + 0.5f + bodyWidth, bottom,
+                sf::Color::Green);
+        green += 6;
+      } else {
+        red -= 6;
+        setQuad(red, x + 0.5f, top, x + 0.5f + bodyWidth, bottom,
+                sf::Color::Red);
+      }
+    }
+  }
+  submitDraw(target, batch.vertices);
+}
+
+// Glyph quads of a string laid out the way sf::Text does, in text-local
+// coordinates.
+struct TextLayout {
+  std::vector<sf::Vertex> vertices; // Triangles
+  sf::FloatRect bounds;
+};
+
+// Layouts for one font and size, keyed by string, so repeated labels are
+// laid out once and a whole set of them draws as one vertex array textured
+// with the font's glyph page.
+struct TextCache {
+  static constexpr size_t MAX_ENTRIES = 4096;
+
+  const sf::Font *font = nullptr;
+  unsigned characterSize = 12;
+  std::unordered_map<std::string, TextLayout> layouts;
+  sf::VertexArray batch{sf::PrimitiveType::Triangles};
+};
+
+const TextLayout &layoutText(TextCache &cache, const std::string &text)
+{
+  auto it = cache.layouts.find(text);
+  if (it != cache.layouts.end())
+    return it->second;
+  if (cache.layouts.size() >= TextCache::MAX_ENTRIES)
+    cache.layouts.clear();
+
+  const sf::Font &font = *cache.font;
+  unsigned size = cache.characterSize;
+  constexpr float PADDING = 1.f; // Matches sf::Text's glyph quad padding
+  TextLayout layout;
+  float minX = size, minY = size, maxX = 0.f, maxY = 0.f;
+  float x = 0.f, y = static_cast<float>(size);
+  char32_t previous = 0;
+  for (unsigned char c : text) {
+    x += font.getKerning(previous, c, size);
+    previous = c;
+    if (c == '\n') {
+      x = 0.f;
+      y += font.getLineSpacing(size);
+      continue;
+    }
+    const sf::Glyph &glyph = font.getGlyph(c, size, false);
+    if (c != ' ') {
+      const sf::FloatRect &b = glyph.bounds;
+      const sf::IntRect &t = glyph.textureRect;
+      float left = x + b.position.x - PADDING, top = y + b.position.y - PADDING;
+      float right = x + b.position.x + b.size.x + PADDING;
+      float bottom = y + b.position.y + b.size.y + PADDING;
+      float u1 = t.position.x - PADDING, v1 = t.position.y - PADDING;
+      float u2 = t.position.x + t.size.x + PADDING;
+      float v2 = t.position.y + t.size.y + PADDING;
+      layout.vertices.insert(layout.vertices.end(),
+                             {{{left, top}, sf::Color::White, {u1, v1}},
+                              {{right, top}, sf::Color::White, {u2, v1}},
+                              {{left, bottom}, sf::Color::White, {u1, v2}},
+                              {{left, bottom}, sf::Color::White, {u1, v2}},
+                              {{right, top}, sf::Color::White, {u2, v1}},
+                              {{right, bottom}, sf::Color::White, {u2, v2}}});
+      minX = std::min(minX, x + b.position.x);
+      maxX = std::max(maxX, x + b.position.x + b.size.x);
+      minY = std::min(minY, y + b.position.y);
+      maxY = std::max(maxY, y + b.position.y + b.size.y);
+    }
+    x += glyph.advance;
+  }
+  if (maxX >= minX)
+    layout.bounds = sf::FloatRect({minX, minY}, {maxX - minX, maxY - minY});
+  return cache.layouts.emplace(text, std::move(layout)).first->second;
+}
+
+void appendText(sf::VertexArray &batch, const TextLayout &layout,
+                const sf::Transform &transform, sf::Color color)
+{
+  for (const auto &vertex : layout.vertices)
+    batch.append({transform.transformPoint(vertex.position), color,
+                  vertex.texCoords});
+}
+
+void drawTextBatch(sf::RenderTarget &target, const TextCache &cache)
+{
+  sf::RenderStates states(&cache.font->getTexture(cache.characterSize));
+  submitDraw(target, cache.batch, states);
+}
+
+// One label (and one vertical grid line) every `step` candles, about one
+// per 50 pixels.
+size_t dateLabelStep(float viewStart, float viewEnd, float chartWidth)
+{
+  float viewWidth = viewEnd - viewStart + 1;
+  size_t numLabels = static_cast<size_t>(viewWidth);
+  return std::max<size_t>(1,
+                          numLabels / std::max<size_t>(1, chartWidth / 50));
+}
+
+void drawDateLabels(sf::RenderTarget &target, TextCache &labels,
+                    const CandleSeries &candles, float viewStart,
+                    float viewEnd, float marginX, float chartBottom,
+                    float chartWidth, float candleWidth, float spacing)
+{
+  size_t step = dateLabelStep(viewStart, viewEnd, chartWidth);
+  labels.batch.clear();
+  for (size_t i = static_cast<size_t>(viewStart);
+       i <= static_cast<size_t>(viewEnd); i += step) {
+    float x = marginX + ((i - viewStart) * (candleWidth + spacing));
+    const TextLayout &layout = layoutText(labels, formatDate(candles.time[i]));
+    sf::Transform transform;
+    transform.translate({x + candleWidth / 2, chartBottom + 50});
+    transform.rotate(sf::degrees(45));
+    transform.translate({-layout.bounds.size.x / 2, 0});
+    appendText(labels.batch, layout, transform, sf::Color::Black);
+  }
+  drawTextBatch(target, labels);
+}
+
+void drawGridLines(sf::RenderTarget &target, sf::VertexArray &grid,
+                   float viewStart, float viewEnd, float marginX,
+                   float chartTop, float chartWidth, float chartHeight,
+                   float candleWidth, float spacing, float viewMinPrice,
+                   float viewMaxPrice)
+{
+  grid.setPrimitiveType(sf::PrimitiveType::Lines);
+  grid.clear();
+  float viewPriceRange = viewMaxPrice - viewMinPrice;
+  float priceStep = viewPriceRange / (NUM_HORIZONTAL_GRID_LINES - 1);
+  // Horizontal grid lines
+  for (int i = 0; i < NUM_HORIZONTAL_GRID_LINES; ++i) {
+    float price = viewMinPrice + i * priceStep;
+    float y =
+        chartTop + ((viewMaxPrice - price) / viewPriceRange * chartHeight);
+    grid.append({{marginX, y}, LIGHT_GRAY});
+    grid.append({{marginX + chartWidth, y}, LIGHT_GRAY});
+  }
+  // Vertical grid lines, one per date label
+  size_t step = dateLabelStep(viewStart, viewEnd, chartWidth);
+  for (size_t i = static_cast<size_t>(viewStart);
+       i <= static_cast<size_t>(viewEnd); i += step) {
+    float x =
+        marginX + ((i - viewStart) * (candleWidth + spacing)) + candleWidth / 2;
+    grid.append({{x, chartTop}, LIGHT_GRAY});
+    grid.append({{x, chartTop + chartHeight}, LIGHT_GRAY});
+  }
+  submitDraw(target, grid);
+}
+
+// Draws the grid, candles and date labels for a view; everything that is
+// cached in the chart layer.
+void drawChart(sf::RenderTarget &target, sf::VertexArray &grid,
+               CandleBatch &batch, TextCache &dateLabels,
+               const CandleSeries &candles, const CandlePyramid &pyramid,
+               float viewStart, float viewEnd, float marginX, float chartTop,
+               float chartWidth, float chartHeight, float viewMinPrice,
+               float viewMaxPrice)
+{
+  float totalWidthPerCandle = chartWidth / (viewEnd - viewStart + 1);
+  float candleWidth = totalWidthPerCandle * CANDLE_WIDTH_FACTOR;
+  float spacing = totalWidthPerCandle * SPACING_FACTOR;
+  {
+    ScopedTimer timer(PHASE_GRID);
+    drawGridLines(target, grid, viewStart, viewEnd, marginX, chartTop,
+                  chartWidth, chartHeight, candleWidth, spacing,
+                  viewMinPrice, viewMaxPrice);
+  }
+  {
+    ScopedTimer timer(PHASE_CANDLES);
+    drawCandlesticks(target, batch, candles, pyramid, viewStart, viewEnd,
+                     marginX, chartTop, chartHeight, candleWidth, spacing,
+                     viewMinPrice, viewMaxPrice);
+  }
+  ScopedTimer timer(PHASE_LABELS);
+  drawDateLabels(target, dateLabels, candles, viewStart, viewEnd, marginX,
+                 chartTop + chartHeight, chartWidth, candleWidth, spacing);
+}
+
+// Interval index over annotation candle ranges: entries sorted by start
+// form an implicit balanced tree in which every node also stores the
+// largest end in its subtree, so a query visits O(log n + k) entries.
+// Rebuilt when annotations are edited, which is rare next to view changes.
+struct IntervalIndex {
+  struct Entry {
+    float lo, hi;
+    uint32_t id;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<float> maxHi;
+};
+
+float buildIntervalNode(IntervalIndex &index, size_t l, size_t r)
+{
+  if (l >= r)
+    return -std::numeric_limits<float>::infinity();
+  size_t m = (l + r) / 2;
+  index.maxHi[m] = std::max({index.entries[m].hi,
+                             buildIntervalNode(index, l, m),
+                             buildIntervalNode(index, m + 1, r)});
+  return index.maxHi[m];
+}
+
+void buildIntervalIndex(IntervalIndex &index,
+                        std::vector<IntervalIndex::Entry> entries)
+{
+  std::sort(entries.begin(), entries.end(),
+            [](const auto &a, const auto &b) { return a.lo < b.lo; });
+  index.entries = std::move(entries);
+  index.maxHi.resize(index.entries.size());
+  buildIntervalNode(index, 0, index.entries.size());
+}
+
+void queryIntervalNode(const IntervalIndex &index, size_t l, size_t r,
+                       float lo, float hi, std::vector<uint32_t> &ids)
+{
+  if (l >= r)
+    return;
+  size_t m = (l + r) / 2;
+  if (index.maxHi[m] < lo)
+    return;
+  queryIntervalNode(index, l, m, lo, hi, ids);
+  if (index.entries[m].lo > hi)
+    return;
+  if (index.entries[m].hi >= lo)
+    ids.push_back(index.entries[m].id);
+  queryIntervalNode(index, m + 1, r, lo, hi, ids);
+}
+
+// Ids of the entries overlapping [lo, hi], in insertion order.
+void queryIntervalIndex(const IntervalIndex &index, float lo, float hi,
+                        std::vector<uint32_t> &ids)
+{
+  ids.clear();
+  queryIntervalNode(index, 0, index.entries.size(), lo, hi, ids);
+  std::sort(ids.begin(), ids.end());
+}
+
+// Spatial indexes and reusable geometry for the committed annotations.
+struct AnnotationBatch {
+  IntervalIndex lineIndex, rectIndex, textIndex;
+  float maxTextWidth = 0.f; // Pixels, widens the text query to the left
+  std::vector<uint32_t> visible;
+  sf::VertexArray lines{sf::PrimitiveType::Lines};
+  sf::VertexArray rects{sf::PrimitiveType::Triangles};
+  TextCache texts;
+};
+
+template <typename Shape>
+std::vector<IntervalIndex::Entry> spanEntries(const std::vector<Shape> &shapes)
+{
+  std::vector<IntervalIndex::Entry> entries;
+  entries.reserve(shapes.size());
+  for (size_t i = 0; i < shapes.size(); ++i)
+    entries.push_back({std::min(shapes[i].startCandle, shapes[i].endCandle),
+                       std::max(shapes[i].startCandle, shapes[i].endCandle),
+                       static_cast<uint32_t>(i)});
+  return entries;
+}
+
+void indexAnnotations(AnnotationBatch &batch,
+                      const std::vector<ChartLine> &lines,
+                      const std::vector<ChartRect> &rects,
+                      const std::vector<ChartText> &texts)
+{
+  buildIntervalIndex(batch.lineIndex, spanEntries(lines));
+  buildIntervalIndex(batch.rectIndex, spanEntries(rects));
+  std::vector<IntervalIndex::Entry> textEntries;
+  batch.maxTextWidth = 0.f;
+  for (size_t i = 0; i < texts.size(); ++i) {
+    textEntries.push_back(
+        {texts[i].candle, texts[i].candle, static_cast<uint32_t>(i)});
+    const sf::FloatRect &bounds = layoutText(batch.texts, texts[i].text).bounds;
+    batch.maxTextWidth =
+        std::max(batch.maxTextWidth, bounds.position.x + bounds.size.x);
+  }
+  buildIntervalIndex(batch.textIndex, std::move(textEntries));
+}
+
+// Candle coordinates spanned by the whole window, margins included.
+void windowCandleRange(float viewStart, float viewEnd, float marginX,
+                       float chartWidth, float &first, float &last)
+{
+  float viewWidth = viewEnd - viewStart + 1;
+  first = viewStart - (marginX / chartWidth) * viewWidth;
+  last = viewStart + ((chartWidth + marginX) / chartWidth) * viewWidth;
+}
+
+void drawLines(sf::RenderTarget &target, AnnotationBatch &batch,
+               const std::vector<ChartLine> &lines, float viewStart,
+               float viewEnd, float marginX, float chartTop, float chartWidth,
+               float chartHeight, float viewMinPrice, float viewMaxPrice)
+{
+  float viewWidth = viewEnd - viewStart + 1;
+  float viewPriceRange = viewMaxPrice - viewMinPrice;
+  float first, last;
+  windowCandleRange(viewStart, viewEnd, marginX, chartWidth, first, last);
+  queryIntervalIndex(batch.lineIndex, first, last, batch.visible);
+  batch.lines.clear();
+  for (uint32_t id : batch.visible) {
+    const auto &line = lines[id];
+    float startX =
+        marginX + ((line.startCandle - viewStart) / viewWidth) * chartWidth;
+    float startY = chartTop + ((viewMaxPrice - line.startPrice) /
+                               viewPriceRange * chartHeight);
+    float endX =
+        marginX + ((line.endCandle - viewStart) / viewWidth) * chartWidth;
+    float endY = chartTop + ((viewMaxPrice - line.endPrice) / viewPriceRange *
+                             chartHeight);
+    batch.lines.append({{startX, startY}, sf::Color::Blue});
+    batch.lines.append({{endX, endY}, sf::Color::Blue});
+  }
+  submitDraw(target, batch.lines);
+}
+
+void drawRectangles(sf::RenderTarget &target, AnnotationBatch &batch,
+                    const std::vector<ChartRect> &rects, float viewStart,
+                    float viewEnd, float marginX, float chartTop,
+                    float chartWidth, float chartHeight, float viewMinPrice,
+                    float viewMaxPrice)
+{
+  float viewWidth = viewEnd - viewStart + 1;
+  float viewPriceRange = viewMaxPrice - viewMinPrice;
+  float first, last;
+  windowCandleRange(viewStart, viewEnd, marginX, chartWidth, first, last);
+  queryIntervalIndex(batch.rectIndex, first, last, batch.visible);
+  batch.rects.resize(30 * batch.visible.size());
+  sf::Vertex *quad = batch.visible.empty() ? nullptr : &batch.rects[0];
+  for (uint32_t id : batch.visible) {
+    const auto &rect = rects[id];
+    float startX =
+        marginX + ((rect.startCandle - viewStart) / viewWidth) * chartWidth;
+    float startY = chartTop + ((viewMaxPrice - rect.startPrice) /
+                               viewPriceRange * chartHeight);
+    float endX =
+        marginX + ((rect.endCandle - viewStart) / viewWidth) * chartWidth;
+    float endY = chartTop + ((viewMaxPrice - rect.endPrice) / viewPriceRange *
+                             chartHeight);
+    float left = std::min(startX, endX), right = std::max(startX, endX);
+    float top = std::min(startY, endY), bottom = std::max(startY, endY);
+    // Fill, then a 1px outline outside it like sf::RectangleShape
+    const sf::Color fill(0, 0, 0, 51), outline = sf::Color::Black;
+    setQuad(quad, left, top, right, bottom, fill);
+    setQuad(quad + 6, left - 1, top - 1, right + 1, top, outline);
+    setQuad(quad + 12, left - 1, bottom, right + 1, bottom + 1, outline);
+    setQuad(quad + 18, left - 1, top, left, bottom, outline);
+    setQuad(quad + 24, right, top, right + 1, bottom, outline);
+    quad += 30;
+  }
+  submitDraw(target, batch.rects);
+}
+
+void drawTexts(sf::RenderTarget &target, AnnotationBatch &batch,
+               const std::vector<ChartText> &texts, float viewStart,
+               float viewEnd, float marginX, float chartTop, float chartWidth,
+               float chartHeight, float viewMinPrice, float viewMaxPrice)
+{
+  float viewWidth = viewEnd - viewStart + 1;
+  float viewPriceRange = viewMaxPrice - viewMinPrice;
+  float first, last;
+  windowCandleRange(viewStart, viewEnd, marginX, chartWidth, first, last);
+  first -= batch.maxTextWidth / chartWidth * viewWidth;
+  queryIntervalIndex(batch.textIndex, first, last, batch.visible);
+  batch.texts.batch.clear();
+  for (uint32_t id : batch.visible) {
+    const auto &text = texts[id];
+    float x = marginX + ((text.candle - viewStart) / viewWidth) * chartWidth;
+    float y =
+        chartTop + ((viewMaxPrice - text.price) / viewPriceRange * chartHeight);
+    sf::Transform transform;
+    transform.translate({x, y});
+    appendText(batch.texts.batch, layoutText(batch.texts, text.text),
+               transform, sf::Color::Black);
+  }
+  drawTextBatch(target, batch.texts);
+}
+
+enum IndicatorKind { SMA, EMA, BOLLINGER, RSI, MACD, ATR, VWAP };
+
+struct IndicatorSpec {
+  IndicatorKind kind;
+  int period;
+  sf::Color color;
+  const char *name;
+};
+
+// Toggled with the number keys 1-9 and 0, in this order.
+constexpr IndicatorSpec INDICATORS[] = {
+    {SMA, 20, sf::Color(255, 140, 0), "SMA 20"},
+    {SMA, 50, sf::Color(0, 120, 255), "SMA 50"},
+    {SMA, 200, sf::Color(160, 0, 200), "SMA 200"},
+    {EMA, 12, sf::Color(0, 170, 170), "EMA 12"},
+    {EMA, 26, sf::Color(200, 0, 120), "EMA 26"},
+    {BOLLINGER, 20, sf::Color(120, 120, 120), "BB 20,2"},
+    {RSI, 14, sf::Color(130, 60, 0), "RSI 14"},
+    {MACD, 26, sf::Color(0, 90, 160), "MACD 12,26,9"},
+    {ATR, 14, sf::Color(90, 140, 0), "ATR 14"},
+    {VWAP, 0, sf::Color(230, 0, 230), "VWAP"}};
+constexpr size_t NUM_INDICATORS = std::size(INDICATORS);
+
+// Lines drawn by each IndicatorKind
+constexpr int INDICATOR_LINES[] = {1, 1, 3, 1, 3, 1, 1};
+
+// Cached indicator values, one per bar in each line (NaN while the
+// indicator warms up). The recurrence state after the last computed bar,
+// and after the one before it, let appended bars and an in-place update of
+// the last bar cost O(1) each; earlier edits recompute from scratch.
+struct Indicator {
+  std::array<std::vector<float>, 3> lines;
+  std::array<double, 3> state{}, previousState{};
+  size_t computed = 0; // Bars with valid values
+};
+
+struct IndicatorSet {
+  std::array<Indicator, NUM_INDICATORS> indicators;
+};
+
+// Drops cached values from bar `dirtyFrom` on, after bars changed.
+void invalidateIndicators(IndicatorSet &set, size_t dirtyFrom)
+{
+  for (auto &indicator : set.indicators) {
+    if (dirtyFrom >= indicator.computed)
+      continue;
+    if (dirtyFrom + 1 == indicator.computed) {
+      indicator.state = indicator.previousState;
+      indicator.computed = dirtyFrom;
+    } else {
+      indicator.computed = 0;
+    }
+  }
+}
+
+// Wilder's smoothing: a running mean over the first `period` values, then
+// an exponential average with alpha 1 / period.
+inline double wilderAverage(double previous, double value, size_t count,
+                            int period)
+{
+  size_t divisor = std::min(count, static_cast<size_t>(period));
+  return previous + (value - previous) / static_cast<double>(divisor);
+}
+
+// Runs `step` over bars [from, n), keeping the state before the last bar.
+template <typename Step>
+void runIndicator(Indicator &indicator, size_t from, size_t n, Step step)
+{
+  std::array<double, 3> state = indicator.state;
+  for (size_t i = from; i + 1 < n; ++i)
+    step(i, state);
+  indicator.previousState = state;
+  step(n - 1, state);
+  indicator.state = state;
+}
+
+// Brings an indicator up to date with the series in one pass over the
+// columns it needs, with the recurrence state held in registers.
+void updateIndicator(IndicatorSet &set, size_t which,
+                     const CandleSeries &candles)
+{
+  const IndicatorSpec &spec = INDICATORS[which];
+  Indicator &indicator = set.indicators[which];
+  size_t n = candles.size();
+  size_t from = indicator.computed;
+  if (from >= n)
+    return;
+  if (from == 0)
+    indicator.state = {};
+  for (int i = 0; i < INDICATOR_LINES[spec.kind]; ++i)
+    indicator.lines[i].resize(n);
+  constexpr float NONE = std::numeric_limits<float>::quiet_NaN();
+  const Price *close = candles.close.data;
+  const Price *high = candles.high.data;
+  const Price *low = candles.low.data;
+  size_t period = static_cast<size_t>(std::max(spec.period, 1));
+  float *out0 = indicator.lines[0].data();
+  float *out1 = indicator.lines[1].data();
+  float *out2 = indicator.lines[2].data();
+
+  switch (spec.kind) {
+  case SMA:
+  case BOLLINGER: {
+    // Sliding sums of closes and squared closes over the window
+    double scale = 1.0 / period;
+    bool bands = spec.kind == BOLLINGER;
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      double c = fromPrice(close[i]);
+      s[0] += c;
+      s[1] += c * c;
+      if (i >= period) {
+        double old = fromPrice(close[i - period]);
+        s[0] -= old;
+        s[1] -= old * old;
+      }
+      if (i + 1 < period) {
+        out0[i] = NONE;
+        if (bands)
+          out1[i] = out2[i] = NONE;
+        return;
+      }
+      double mean = s[0] * scale;
+      out0[i] = static_cast<float>(mean);
+      if (bands) {
+        double deviation =
+            std::sqrt(std::max(0.0, s[1] * scale - mean * mean));
+        out1[i] = static_cast<float>(mean + 2.0 * deviation);
+        out2[i] = static_cast<float>(mean - 2.0 * deviation);
+      }
+    });
+    break;
+  }
+  case EMA: {
+    double alpha = 2.0 / (period + 1);
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      double c = fromPrice(close[i]);
+      s[0] = i == 0 ? c : s[0] + alpha * (c - s[0]);
+      out0[i] = i + 1 >= period ? static_cast<float>(s[0]) : NONE;
+    });
+    break;
+  }
+  case RSI: {
+    // s[0] and s[1] are the average gain and loss
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      if (i == 0) {
+        out0[i] = NONE;
+        return;
+      }
+      double change = fromPrice(close[i]) - fromPrice(close[i - 1]);
+      s[0] = wilderAverage(s[0], std::max(change, 0.0), i, spec.period);
+      s[1] = wilderAverage(s[1], std::max(-change, 0.0), i, spec.period);
+      if (i < period)
+        out0[i] = NONE;
+      else if (s[1] == 0.0)
+        out0[i] = 100.f;
+      else
+        out0[i] = static_cast<float>(100.0 - 100.0 / (1.0 + s[0] / s[1]));
+    });
+    break;
+  }
+  case MACD: {
+    // s holds the fast and slow EMAs of closes and the signal EMA of MACD;
+    // lines are MACD, signal and histogram
+    constexpr size_t FAST = 12, SLOW = 26, SIGNAL = 9;
+    constexpr double FAST_ALPHA = 2.0 / (FAST + 1);
+    constexpr double SLOW_ALPHA = 2.0 / (SLOW + 1);
+    constexpr double SIGNAL_ALPHA = 2.0 / (SIGNAL + 1);
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      double c = fromPrice(close[i]);
+      s[0] = i == 0 ? c : s[0] + FAST_ALPHA * (c - s[0]);
+      s[1] = i == 0 ? c : s[1] + SLOW_ALPHA * (c - s[1]);
+      double macd = s[0] - s[1];
+      s[2] = i == 0 ? macd : s[2] + SIGNAL_ALPHA * (macd - s[2]);
+      bool ready = i + 2 >= SLOW + SIGNAL;
+      out0[i] = i + 1 >= SLOW ? static_cast<float>(macd) : NONE;
+      out1[i] = ready ? static_cast<float>(s[2]) : NONE;
+      out2[i] = ready ? static_cast<float>(macd - s[2]) : NONE;
+    });
+    break;
+  }
+  case ATR: {
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      double h = fromPrice(high[i]), l = fromPrice(low[i]);
+      double range = h - l;
+      if (i > 0) {
+        double previousClose = fromPrice(close[i - 1]);
+        range = std::max({range, std::abs(h - previousClose),
+                          std::abs(l - previousClose)});
+      }
+      s[0] = i == 0 ? range : wilderAverage(s[0], range, i + 1, spec.period);
+      out0[i] = i + 1 >= period ? static_cast<float>(s[0]) : NONE;
+    });
+    break;
+  }
+  case VWAP: {
+    // s[0] and s[1] are cumulative price * volume and volume. Resets each
+    // day for intraday bars; anchored at the first bar otherwise.
+    const int64_t *time = candles.time.data;
+    const float *volume = candles.volume.data;
+    bool intraday = n > 1 && time[1] - time[0] < SECONDS_PER_DAY;
+    runIndicator(indicator, from, n, [&](size_t i, auto &s) {
+      double typical =
+          (fromPrice(high[i]) + fromPrice(low[i]) + fromPrice(close[i])) /
+          3.0;
+      if (i == 0 || (intraday && time[i] / SECONDS_PER_DAY !=
+                                     time[i - 1] / SECONDS_PER_DAY))
+        s[0] = s[1] = 0.0;
+      s[0] += typical * volume[i];
+      s[1] += volume[i];
+      out0[i] = static_cast<float>(s[1] > 0.0 ? s[0] / s[1] : typical);
+    });
+    break;
+  }
+  }
+  indicator.computed = n;
+}
+
+// Oscillators are drawn in a band at the bottom of the chart on their own
+// scale; the rest share the price scale.
+constexpr float OSCILLATOR_BAND = 0.25f;
+
+bool isOscillator(IndicatorKind kind)
+{
+  return kind == RSI || kind == MACD || kind == ATR;
+}
+
+// Draws the shown indicators as polylines in one batch, through the same
+// candle-to-pixel transform as drawLines, with a legend at the top left.
+// Views wider than the chart sample one bar per pixel column.
+void drawIndicators(sf::RenderTarget &target, sf::VertexArray &batch,
+                    TextCache &legend, IndicatorSet &set,
+                    const std::array<bool, NUM_INDICATORS> &shown,
+                    const CandleSeries &candles, float viewStart,
+                    float viewEnd, float marginX, float chartTop,
+                    float chartWidth, float chartHeight, float viewMinPrice,
+                    float viewMaxPrice)
+{
+  batch.setPrimitiveType(sf::PrimitiveType::Lines);
+  batch.clear();
+  legend.batch.clear();
+  float viewWidth = viewEnd - viewStart + 1;
+  size_t first = static_cast<size_t>(std::max(0.f, viewStart));
+  size_t last = std::min(static_cast<size_t>(std::ceil(viewEnd)),
+                         candles.size() - 1);
+  size_t step = std::max<size_t>(
+      1, static_cast<size_t>((last - first + 1) / chartWidth));
+  float bandTop = chartTop + chartHeight * (1.f - OSCILLATOR_BAND);
+  float bandHeight = chartHeight * OSCILLATOR_BAND;
+  float legendY = chartTop + MODAL_PADDING;
+
+  for (size_t which = 0; which < NUM_INDICATORS; ++which) {
+    if (!shown[which])
+      continue;
+    const IndicatorSpec &spec = INDICATORS[which];
+    updateIndicator(set, which, candles);
+    const Indicator &indicator = set.indicators[which];
+    int numLines = INDICATOR_LINES[spec.kind];
+
+    // Vertical mapping: the view's price range, or the oscillator's own
+    // range over the visible bars
+    float low = viewMinPrice, high = viewMaxPrice, top = chartTop,
+          height = chartHeight;
+    if (isOscillator(spec.kind)) {
+      top = bandTop;
+      height = bandHeight;
+      if (spec.kind == RSI) {
+        low = 0.f;
+        high = 100.f;
+      } else {
+        low = std::numeric_limits<float>::max();
+        high = std::numeric_limits<float>::lowest();
+        for (int line = 0; line < numLines; ++line) {
+          for (size_t i = first; i <= last; i += step) {
+            float value = indicator.lines[line][i];
+            if (!std::isnan(value)) {
+              low = std::min(low, value);
+              high = std::max(high, value);
+            }
+          }
+        }
+        if (spec.kind == ATR)
+          low = 0.f;
+        if (!(high > low))
+          continue;
+      }
+    }
+    float yScale = height / (high - low);
+
+    for (int line = 0; line < numLines; ++line) {
+      const float *values = indicator.lines[line].data();
+      sf::Vertex previous;
+      bool hasPrevious = false;
+      for (size_t i = first;; i += step) {
+        i = std::min(i, last);
+        float value = values[i];
+        if (std::isnan(value)) {
+          hasPrevious = false;
+        } else {
+          float x = marginX + ((i + CANDLE_WIDTH_FACTOR / 2 - viewStart) /
+                               viewWidth) * chartWidth;
+          sf::Vertex vertex{{x, top + (high - value) * yScale}, spec.color};
+          if (hasPrevious) {
+            batch.append(previous);
+            batch.append(vertex);
+          }
+          previous = vertex;
+          hasPrevious = true;
+        }
+        if (i == last)
+          break;
+      }
+    }
+
+    const TextLayout &layout = layoutText(legend, spec.name);
+    sf::Transform transform;
+    transform.translate({marginX + MODAL_PADDING, legendY});
+    appendText(legend.batch, layout, transform, spec.color);
+    legendY += layout.bounds.size.y + MODAL_PADDING;
+  }
+  submitDraw(target, batch);
+  drawTextBatch(target, legend);
+}
+
+// Adds each candle's volume in [first, end), spread evenly over the
+// buckets its low-high range touches, to a difference array of
+// numBuckets + 1 entries.
+void accumulateVolume(const CandleSeries &candles, size_t first, size_t end,
+                      float minPrice, float bucketsPerPrice,
+                      size_t numBuckets, double *diff)
+{
+  int maxBucket = static_cast<int>(numBuckets) - 1;
+  for (size_t i = first; i < end; ++i) {
+    int lo = std::clamp(static_cast<int>((fromPrice(candles.low[i]) -
+                                          minPrice) * bucketsPerPrice),
+                        0, maxBucket);
+    int hi = std::clamp(static_cast<int>((fromPrice(candles.high[i]) -
+                                          minPrice) * bucketsPerPrice),
+                        lo, maxBucket);
+    double share = candles.volume[i] / (hi - lo + 1);
+    diff[lo] += share;
+    diff[hi + 1] -= share;
+  }
+}
+
+// Volume by price over candles [first, last] in `buckets.size()` equal
+// price buckets from minPrice to maxPrice. Long ranges are split across
+// threads, each with its own difference array, summed afterwards.
+void computeVolumeProfile(const CandleSeries &candles, size_t first,
+                          size_t last, float minPrice, float maxPrice,
+                          std::vector<double> &buckets)
+{
+  constexpr size_t MIN_BARS_PER_THREAD = 1 << 18;
+  size_t numBuckets = buckets.size();
+  size_t count = last - first + 1;
+  float bucketsPerPrice =
+      maxPrice > minPrice ? numBuckets / (maxPrice - minPrice) : 0.f;
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  size_t numThreads =
+      std::clamp<size_t>(count / MIN_BARS_PER_THREAD, 1, maxThreads);
+
+  std::vector<double> diffs((numBuckets + 1) * numThreads, 0.0);
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < numThreads; ++t)
+    workers.emplace_back(accumulateVolume, std::cref(candles),
+                         first + count * t / numThreads,
+                         first + count * (t + 1) / numThreads, minPrice,
+                         bucketsPerPrice, numBuckets,
+                         diffs.data() + t * (numBuckets + 1));
+  accumulateVolume(candles, first, first + count / numThreads, minPrice,
+                   bucketsPerPrice, numBuckets, diffs.data());
+  for (auto &worker : workers)
+    worker.join();
+
+  double running = 0.0;
+  for (size_t b = 0; b < numBuckets; ++b) {
+    for (size_t t = 0; t < numThreads; ++t)
+      running += diffs[t * (numBuckets + 1) + b];
+    buckets[b] = running;
+  }
+}
+
+// Draws the profile as horizontal bars growing left from the right edge of
+// the chart, the bucket with the most volume highlighted.
+void drawVolumeProfile(sf::RenderTarget &target, sf::VertexArray &batch,
+                       const std::vector<double> &buckets, float marginX,
+                       float chartTop, float chartWidth, float chartHeight)
+{
+  constexpr float PANEL_WIDTH = 0.2f; // Of the chart width
+  const sf::Color FILL(70, 110, 200, 90), PEAK(70, 110, 200, 160);
+  if (buckets.empty())
+    return;
+  size_t peak = std::max_element(buckets.begin(), buckets.end()) -
+                buckets.begin();
+  if (buckets[peak] <= 0.0)
+    return;
+  batch.setPrimitiveType(sf::PrimitiveType::Triangles);
+  batch.resize(6 * buckets.size());
+  float right = marginX + chartWidth;
+  float scale = chartWidth * PANEL_WIDTH / static_cast<float>(buckets[peak]);
+  float bucketHeight = chartHeight / buckets.size();
+  for (size_t b = 0; b < buckets.size(); ++b) {
+    float bottom = chartTop + chartHeight - b * bucketHeight;
+    setQuad(&batch[6 * b], right - static_cast<float>(buckets[b]) * scale,
+            bottom - bucketHeight + 1.f, right, bottom,
+            b == peak ? PEAK : FILL);
+  }
+  submitDraw(target, batch);
+}
+
+// Draws a labelled progress bar, `fraction` of it filled.
+void drawLoadProgress(sf::RenderTarget &target, sf::Text &text,
+                      sf::RectangleShape &bar, const std::string &label,
+                      float fraction, float x, float y, float width)
+{
+  constexpr float BAR_OFFSET = 20.f, BAR_HEIGHT = 4.f;
+  text.setString(label + " " +
+                 std::to_string(static_cast<int>(fraction * 100.f)) + "%");
+  text.setPosition({x, y});
+  submitDraw(target, text);
+  bar.setPosition({x, y + BAR_OFFSET});
+  bar.setSize({width, BAR_HEIGHT});
+  bar.setFillColor(LIGHT_GRAY);
+  submitDraw(target, bar);
+  bar.setSize({width * std::clamp(fraction, 0.f, 1.f), BAR_HEIGHT});
+  bar.setFillColor(sf::Color(70, 130, 180));
+  submitDraw(target, bar);
+}
+
+// Maps a mouse position straight to the candle under it, wick included,
+// using the same layout as drawCandlesticks. Returns NO_CANDLE if none.
+size_t hitTestCandle(const CandleSeries &candles, sf::Vector2f mouse,
+                     float viewStart, float viewEnd, float marginX,
+                     float chartTop, float chartHeight, float candleWidth,
+                     float spacing, float viewMinPrice, float viewMaxPrice)
+{
+  float slot = viewStart + (mouse.x - marginX) / (candleWidth + spacing);
+  if (slot < 0.f)
+    return NO_CANDLE;
+  size_t i = static_cast<size_t>(slot);
+  if (i < static_cast<size_t>(viewStart) || i > static_cast<size_t>(viewEnd) ||
+      i >= candles.size())
+    return NO_CANDLE;
+  float x = marginX + ((i - viewStart) * (candleWidth + spacing));
+  float highY = chartTop + ((viewMaxPrice - fromPrice(candles.high[i])) /
+                            (viewMaxPrice - viewMinPrice) * chartHeight);
+  float lowY = chartTop + ((viewMaxPrice - fromPrice(candles.low[i])) /
+                           (viewMaxPrice - viewMinPrice) * chartHeight);
+  sf::FloatRect candleRect({x, highY}, {candleWidth, lowY - highY});
+  return candleRect.contains(mouse) ? i : NO_CANDLE;
+}
+
+enum Timeframe {
+  TIMEFRAME_BASE, // Bars as loaded
+  TIMEFRAME_WEEK,
+  TIMEFRAME_MONTH,
+  TIMEFRAME_QUARTER,
+  NUM_TIMEFRAMES
+};
+constexpr const char *TIMEFRAME_NAMES[NUM_TIMEFRAMES] = {
+    "", "weekly", "monthly", "quarterly"};
+
+// End, exclusive, of the calendar period containing `time`: Monday-based
+// weeks, months or quarters.
+int64_t periodEnd(int64_t time, Timeframe timeframe)
+{
+  int64_t days = time >= 0 ? time / SECONDS_PER_DAY
+                           : (time - SECONDS_PER_DAY + 1) / SECONDS_PER_DAY;
+  if (timeframe == TIMEFRAME_WEEK) { // 1970-01-01 was a Thursday
+    int64_t sinceMonday = days + 3;
+    int64_t week = sinceMonday >= 0 ? sinceMonday / 7 : (sinceMonday - 6) / 7;
+    return ((week + 1) * 7 - 3) * SECONDS_PER_DAY;
+  }
+  int64_t year;
+  unsigned month, day;
+  civilFromDays(days, year, month, day);
+  unsigned next = timeframe == TIMEFRAME_MONTH ? month + 1
+                                               : (month - 1) / 3 * 3 + 4;
+  if (next > 12) {
+    next -= 12;
+    ++year;
+  }
+  return daysFromCivil(year, next, 1) * SECONDS_PER_DAY;
+}
+
+// A paged series is read in chunks of PAGE_CHUNK candles, each summarized
+// by one candle of pyramid level PAGE_CHUNK_LEVEL.
+constexpr size_t PAGE_CHUNK_LEVEL = 16;
+constexpr size_t PAGE_CHUNK = size_t(1) << PAGE_CHUNK_LEVEL;
+// A chunk with its share of the stored pyramid levels
+constexpr size_t PAGE_CHUNK_BYTES =
+    PAGE_CHUNK * (4 * sizeof(Price) + sizeof(float) + sizeof(int64_t)) * 9 /
+    8;
+constexpr size_t MIN_PAGE_CHUNKS = 8;
+
+struct ChunkRange {
+  size_t first = 0, end = 0;
+  bool operator==(const ChunkRange &) const = default;
+};
+
+// The chunks of a series mapped from a cache larger than the page budget
+// that are kept resident. budgetChunks is 0 for series held in memory.
+struct PageWindow {
+  size_t budgetChunks = 0;
+  std::array<ChunkRange, 2> kept{}; // Around the view, or at its two edges
+  size_t lastFirst = 0;             // View start at the last update
+  RangeIndex<Price> chunkIndex;     // Over the chunk summaries
+};
+
+// A candle series with the indexes and caches derived from it. Resampled
+// series also record the first base bar of each of their bars.
+struct ChartSeries {
+  CandleSeries candles;
+  CandlePyramid pyramid;
+  RangeIndex<Price> priceIndex;
+  CandleBatch candleBatch;
+  IndicatorSet indicators;
+  std::vector<size_t> baseStarts;
+  size_t staleFrom = 0; // First base bar to resample; SIZE_MAX if current
+  PageWindow pages;
+};
+
+// Pages a series mapped from a cache if it is larger than `budget` bytes:
+// its pyramid is read from the cache instead of built, and only the chunks
+// near the view stay resident. Returns false if it stays in memory.
+bool pageSeries(ChartSeries &series, size_t budget)
+{
+  const CandleSeries &candles = series.candles;
+  size_t numChunks = (candles.size() + PAGE_CHUNK - 1) / PAGE_CHUNK;
+  size_t budgetChunks = std::max(MIN_PAGE_CHUNKS, budget / PAGE_CHUNK_BYTES);
+  if (numChunks <= budgetChunks || !mapCachePyramid(candles, series.pyramid))
+    return false;
+  const CandleSeries &chunks = series.pyramid.levels[PAGE_CHUNK_LEVEL - 1];
+  updateRangeIndex(series.pages.chunkIndex, chunks.low.data, chunks.high.data,
+                   chunks.size());
+  series.pages.budgetChunks = budgetChunks;
+  // Readahead is left to updatePageWindow
+  ::madvise(const_cast<char *>(candles.mapping.data), candles.mapping.size,
+            MADV_RANDOM);
+  return true;
+}
+
+// Brings a paged series back into memory so bars can be appended: the
+// columns are copied out of the cache and the pyramid and price index are
+// built in full.
+void unpageSeries(ChartSeries &series)
+{
+  CandleSeries &candles = series.candles;
+  ::madvise(const_cast<char *>(candles.mapping.data), candles.mapping.size,
+            MADV_SEQUENTIAL);
+  candles.resize(candles.size());
+  series.pyramid = {};
+  updateCandlePyramid(series.pyramid, candles);
+  updateRangeIndex(series.priceIndex, candles.low.data, candles.high.data,
+                   candles.size());
+  series.pages = {};
+}
+
+// Applies `advice` to the pages holding a range of chunks in the base
+// columns and the stored levels below the chunk summaries, which are small
+// enough to stay resident. MADV_DONTNEED only covers pages entirely inside
+// the range so that it never drops the edge of a neighbouring chunk.
+void adviseChunks(const ChartSeries &series, ChunkRange range, int advice)
+{
+  static const size_t PAGE_SIZE = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  auto advise = [&]<typename T>(const Column<T> &column, size_t level) {
+    size_t first = std::min(column.size, (range.first * PAGE_CHUNK) >> level);
+    size_t end = std::min(column.size, (range.end * PAGE_CHUNK) >> level);
+    if (first >= end)
+      return;
+    uintptr_t begin = reinterpret_cast<uintptr_t>(column.data + first);
+    uintptr_t stop = reinterpret_cast<uintptr_t>(column.data + end);
+    if (advice == MADV_DONTNEED) {
+      begin += (PAGE_SIZE - begin % PAGE_SIZE) % PAGE_SIZE;
+      stop -= stop % PAGE_SIZE;
+    } else {
+      begin -= begin % PAGE_SIZE;
+      stop += (PAGE_SIZE - stop % PAGE_SIZE) % PAGE_SIZE;
+    }
+    if (begin < stop)
+      ::madvise(reinterpret_cast<void *>(begin), stop - begin, advice);
+  };
+  for (size_t level = 0; level < PAGE_CHUNK_LEVEL; ++level) {
+    if (level && level < CACHE_FIRST_LEVEL)
+      continue;
+    const CandleSeries &candles =
+        level ? series.pyramid.levels[level - 1] : series.candles;
+    advise(candles.open, level);
+    advise(candles.high, level);
+    advise(candles.low, level);
+    advise(candles.close, level);
+    advise(candles.volume, level);
+    advise(candles.time, level);
+  }
+}
+
+// Keeps the chunks around bars [first, last] of a paged series resident
+// and releases the rest. Spare budget goes mostly ahead in the pan
+// direction and is prefetched. A view wider than the budget is drawn from
+// the stored levels, so only the chunks at its edges are kept.
+void updatePageWindow(ChartSeries &series, size_t first, size_t last)
+{
+  PageWindow &pages = series.pages;
+  if (!pages.budgetChunks)
+    return;
+  size_t numChunks = (series.candles.size() + PAGE_CHUNK - 1) / PAGE_CHUNK;
+  size_t firstChunk = first / PAGE_CHUNK, lastChunk = last / PAGE_CHUNK;
+  size_t visible = lastChunk - firstChunk + 1;
+  std::array<ChunkRange, 2> kept{};
+  if (visible + 2 <= pages.budgetChunks) {
+    size_t spare = pages.budgetChunks - visible;
+    size_t after = spare / 2;
+    if (first != pages.lastFirst)
+      after = first > pages.lastFirst ? spare * 3 / 4 : spare / 4;
+    size_t before = spare - after;
+    kept[0] = {firstChunk - std::min(firstChunk, before),
+               std::min(numChunks, lastChunk + 1 + after)};
+  } else {
+    kept[0] = {firstChunk ? firstChunk - 1 : 0, firstChunk + 2};
+    kept[1] = {lastChunk - 1, std::min(numChunks, lastChunk + 2)};
+  }
+  pages.lastFirst = first;
+  if (kept == pages.kept)
+    return;
+
+  // Everything outside the window goes, including pages touched by full
+  // scans such as resampling
+  size_t from = 0;
+  for (const ChunkRange &range : kept) {
+    if (range.first == range.end)
+      continue;
+    if (from < range.first)
+      adviseChunks(series, {from, range.first}, MADV_DONTNEED);
+    from = range.end;
+  }
+  if (from < numChunks)
+    adviseChunks(series, {from, numChunks}, MADV_DONTNEED);
+  for (const ChunkRange &range : kept) {
+    if (range.first < range.end)
+      adviseChunks(series, range, MADV_WILLNEED);
+  }
+  pages.kept = kept;
+}
+
+// Price range of bars [first, last]. A paged series answers whole chunks
+// from their summaries and reads raw pages only at the edges.
+void queryPriceRange(const ChartSeries &series, size_t first, size_t last,
+                     Price &minValue, Price &maxValue)
+{
+  const CandleSeries &candles = series.candles;
+  if (!series.pages.budgetChunks) {
+    queryRangeIndex(series.priceIndex, candles.low.data, candles.high.data,
+                    first, last, minValue, maxValue);
+    return;
+  }
+  size_t firstChunk = (first + PAGE_CHUNK - 1) / PAGE_CHUNK;
+  size_t endChunk = (last + 1) / PAGE_CHUNK; // One past the last whole chunk
+  if (firstChunk >= endChunk) {
+    columnMinMax(candles.low.data, candles.high.data, first, last, minValue,
+                 maxValue);
+    return;
+  }
+  const CandleSeries &chunks = series.pyramid.levels[PAGE_CHUNK_LEVEL - 1];
+  queryRangeIndex(series.pages.chunkIndex, chunks.low.data, chunks.high.data,
+                  firstChunk, endChunk - 1, minValue, maxValue);
+  Price partMin, partMax;
+  if (first < firstChunk * PAGE_CHUNK) {
+    columnMinMax(candles.low.data, candles.high.data, first,
+                 firstChunk * PAGE_CHUNK - 1, partMin, partMax);
+    minValue = std::min(minValue, partMin);
+    maxValue = std::max(maxValue, partMax);
+  }
+  if (last >= endChunk * PAGE_CHUNK) {
+    columnMinMax(candles.low.data, candles.high.data, endChunk * PAGE_CHUNK,
+                 last, partMin, partMax);
+    minValue = std::min(minValue, partMin);
+    maxValue = std::max(maxValue, partMax);
+  }
+}
+
+// The cached layers a frame is composited from, the chart (grid, candles,
+// labels, indicators and volume profile) and the committed annotations,
+// with the geometry reused between renders.
+struct ChartLayers {
+  sf::RenderTexture chart, annotations;
+  sf::VertexArray grid;
+  TextCache dateLabels;
+  std::vector<double> volumeProfile;
+  sf::VertexArray volumeBatch;
+  sf::VertexArray indicatorBatch;
+  TextCache indicatorLegend;
+  AnnotationBatch annotationBatch;
+
+  ChartLayers(sf::Vector2u size, const sf::Font &font, size_t volumeBuckets)
+      : chart(size), annotations(size), volumeProfile(volumeBuckets)
+  {
+    dateLabels.font = &font;
+    indicatorLegend.font = &font;
+    annotationBatch.texts.font = &font;
+    annotationBatch.texts.characterSize = 16;
+  }
+};
+
+void renderChartLayer(ChartLayers &layers, ChartSeries &shown,
+                      const std::array<bool, NUM_INDICATORS> &indicatorsShown,
+                      bool showVolumeProfile, float viewStart, float viewEnd,
+                      float marginX, float chartTop, float chartWidth,
+                      float chartHeight, float viewMinPrice,
+                      float viewMaxPrice)
+{
+  const CandleSeries &candles = shown.candles;
+  layers.chart.clear(sf::Color::White);
+  drawChart(layers.chart, layers.grid, shown.candleBatch, layers.dateLabels,
+            candles, shown.pyramid, viewStart, viewEnd, marginX, chartTop,
+            chartWidth, chartHeight, viewMinPrice, viewMaxPrice);
+  // Indicators and profiles scan whole ranges, which a paged series does
+  // not hold
+  bool paged = shown.pages.budgetChunks != 0;
+  if (!paged && std::find(indicatorsShown.begin(), indicatorsShown.end(),
+                          true) != indicatorsShown.end()) {
+    ScopedTimer timer(PHASE_INDICATORS);
+    drawIndicators(layers.chart, layers.indicatorBatch, layers.indicatorLegend,
+                   shown.indicators, indicatorsShown, candles, viewStart,
+                   viewEnd, marginX, chartTop, chartWidth, chartHeight,
+                   viewMinPrice, viewMaxPrice);
+  }
+  if (showVolumeProfile && !paged) {
+    ScopedTimer timer(PHASE_VOLUME_PROFILE);
+    computeVolumeProfile(candles, static_cast<size_t>(viewStart),
+                         static_cast<size_t>(viewEnd), viewMinPrice,
+                         viewMaxPrice, layers.volumeProfile);
+    drawVolumeProfile(layers.chart, layers.volumeBatch, layers.volumeProfile,
+                      marginX, chartTop, chartWidth, chartHeight);
+  }
+  layers.chart.display();
+}
+
+// Re-renders the annotation layer, first re-indexing the annotations if
+// they were edited.
+void renderAnnotationLayer(ChartLayers &layers,
+                           const std::vector<ChartLine> &lines,
+                           const std::vector<ChartRect> &rects,
+                           const std::vector<ChartText> &texts, bool edited,
+                           float viewStart, float viewEnd, float marginX,
+                           float chartTop, float chartWidth, float chartHeight,
+                           float viewMinPrice, float viewMaxPrice)
+{
+  if (edited) {
+    ScopedTimer timer(PHASE_ANNOTATION_INDEX);
+    indexAnnotations(layers.annotationBatch, lines, rects, texts);
+  }
+  layers.annotations.clear(sf::Color::Transparent);
+  {
+    ScopedTimer timer(PHASE_LINES);
+    drawLines(layers.annotations, layers.annotationBatch, lines, viewStart,
+              viewEnd, marginX, chartTop, chartWidth, chartHeight,
+              viewMinPrice, viewMaxPrice);
+  }
+  {
+    ScopedTimer timer(PHASE_RECTS);
+    drawRectangles(layers.annotations, layers.annotationBatch, rects,
+                   viewStart, viewEnd, marginX, chartTop, chartWidth,
+                   chartHeight, viewMinPrice, viewMaxPrice);
+  }
+  {
+    ScopedTimer timer(PHASE_TEXTS);
+    drawTexts(layers.annotations, layers.annotationBatch, texts, viewStart,
+              viewEnd, marginX, chartTop, chartWidth, chartHeight,
+              viewMinPrice, viewMaxPrice);
+  }
+  layers.annotations.display();
+}
+
+inline void appendBar(CandleSeries &out, const CandleSeries &from, size_t i)
+{
+  out.open.push_back(from.open[i]);
+  out.high.push_back(from.high[i]);
+  out.low.push_back(from.low[i]);
+  out.close.push_back(from.close[i]);
+  out.volume.push_back(from.volume[i]);
+  out.time.push_back(from.time[i]);
+}
+
+// Folds bar `i` of `from` into the last bar of `out`.
+inline void mergeBar(CandleSeries &out, const CandleSeries &from, size_t i)
+{
+  size_t last = out.size() - 1;
+  out.high[last] = std::max(out.high[last], from.high[i]);
+  out.low[last] = std::min(out.low[last], from.low[i]);
+  out.close[last] = from.close[i];
+  out.volume[last] += from.volume[i];
+}
+
+// Rolls base bars [first, end) into one bar per calendar period, dated by
+// the first base bar of the period. The calendar is only consulted when a
+// bar crosses the end of the current period.
+void resampleRange(const CandleSeries &base, size_t first, size_t end,
+                   Timeframe timeframe, CandleSeries &out,
+                   std::vector<size_t> &starts)
+{
+  int64_t currentEnd = 0;
+  for (size_t i = first; i < end; ++i) {
+    if (i == first || base.time[i] >= currentEnd) {
+      appendBar(out, base, i);
+      starts.push_back(i);
+      currentEnd = periodEnd(base.time[i], timeframe);
+    } else {
+      mergeBar(out, base, i);
+    }
+  }
+  ++out.revision;
+}
+
+// Brings a resampled series up to date from base bar `from` on. Periods
+// that end before it are kept. Long ranges are split across threads and
+// periods straddling a split are merged afterwards.
+void resampleSeries(ChartSeries &series, const CandleSeries &base,
+                    Timeframe timeframe, size_t from)
+{
+  constexpr size_t MIN_BARS_PER_THREAD = 1 << 18;
+  CandleSeries &out = series.candles;
+  std::vector<size_t> &starts = series.baseStarts;
+  size_t keep = static_cast<size_t>(
+      std::upper_bound(starts.begin(), starts.end(), from) - starts.begin());
+  keep -= keep > 0; // The period containing `from` is rebuilt
+  size_t restart = keep < starts.size() ? starts[keep] : 0;
+  out.resize(keep);
+  starts.resize(keep);
+
+  size_t count = base.size() - restart;
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  size_t numThreads =
+      std::clamp<size_t>(count / MIN_BARS_PER_THREAD, 1, maxThreads);
+  if (numThreads == 1) {
+    resampleRange(base, restart, base.size(), timeframe, out, starts);
+  } else {
+    std::vector<CandleSeries> parts(numThreads);
+    std::vector<std::vector<size_t>> partStarts(numThreads);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < numThreads; ++t)
+      workers.emplace_back(resampleRange, std::cref(base),
+                           restart + count * t / numThreads,
+                           restart + count * (t + 1) / numThreads, timeframe,
+                           std::ref(parts[t]), std::ref(partStarts[t]));
+    resampleRange(base, restart, restart + count / numThreads, timeframe,
+                  parts[0], partStarts[0]);
+    for (auto &worker : workers)
+      worker.join();
+    for (size_t t = 0; t < numThreads; ++t) {
+      const CandleSeries &part = parts[t];
+      size_t first = 0;
+      if (!out.empty() && !part.empty() &&
+          periodEnd(out.time[out.size() - 1], timeframe) ==
+              periodEnd(part.time[0], timeframe)) {
+        mergeBar(out, part, 0);
+        first = 1;
+      }
+      out.reserve(out.size() + part.size() - first);
+      for (size_t j = first; j < part.size(); ++j) {
+        appendBar(out, part, j);
+        starts.push_back(partStarts[t][j]);
+      }
+    }
+    ++out.revision;
+  }
+
+  updateCandlePyramid(series.pyramid, out, keep);
+  updateRangeIndex(series.priceIndex, out.low.data, out.high.data,
+                   out.size(), keep);
+  invalidateIndicators(series.indicators, keep);
+  series.staleFrom = SIZE_MAX;
+}
+
+// Index of the resampled bar covering base bar `baseIndex`.
+size_t barCovering(const std::vector<size_t> &starts, size_t baseIndex)
+{
+  auto it = std::upper_bound(starts.begin(), starts.end(), baseIndex);
+  return it == starts.begin() ? 0
+                              : static_cast<size_t>(it - starts.begin()) - 1;
+}
+
+// Converts a fractional bar coordinate of a series to base bars and back,
+// spreading each period evenly over the base bars it covers so annotations
+// keep their dates across timeframes. Coordinates past either end
+// extrapolate with the width of the end period.
+float toBaseCoordinate(const ChartSeries &series, size_t baseSize, float x)
+{
+  const std::vector<size_t> &starts = series.baseStarts;
+  size_t n = starts.size();
+  if (n == 0)
+    return x;
+  auto start = [&](size_t k) { return static_cast<float>(starts[k]); };
+  auto width = [&](size_t k) {
+    return static_cast<float>(k + 1 < n ? starts[k + 1] : baseSize) -
+           start(k);
+  };
+  if (x < 0.f)
+    return x * width(0);
+  if (x >= n)
+    return baseSize + (x - n) * width(n - 1);
+  size_t k = static_cast<size_t>(x);
+  return start(k) + (x - k) * width(k);
+}
+
+float fromBaseCoordinate(const ChartSeries &series, size_t baseSize, float x)
+{
+  const std::vector<size_t> &starts = series.baseStarts;
+  size_t n = starts.size();
+  if (n == 0)
+    return x;
+  auto start = [&](size_t k) { return static_cast<float>(starts[k]); };
+  auto width = [&](size_t k) {
+    return static_cast<float>(k + 1 < n ? starts[k + 1] : baseSize) -
+           start(k);
+  };
+  if (x < 0.f)
+    return x / width(0);
+  if (x >= baseSize)
+    return n + (x - baseSize) / width(n - 1);
+  size_t k = barCovering(starts, static_cast<size_t>(x));
+  return k + (x - start(k)) / width(k);
+}
+
+// Fixed set of worker threads, each with its own task deque. Workers run
+// their own tasks oldest first and, when out of work, steal the newest task
+// of another worker, so a few long tasks do not leave cores idle behind
+// them. Tasks submitted by a worker go to its own deque; others are dealt
+// round robin.
+struct ThreadPool {
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<Queue> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> pending{0}; // Tasks queued in all deques
+  std::atomic<size_t> nextQueue{0};
+  std::mutex mutex; // Held to sleep on `wake` and to stop
+  std::condition_variable wake;
+  std::atomic<bool> stopping{false};
+
+  static inline thread_local const ThreadPool *currentPool = nullptr;
+  static inline thread_local size_t currentWorker = 0;
+
+  explicit ThreadPool(size_t numThreads)
+      : queues(std::max<size_t>(numThreads, 1))
+  {
+    for (size_t i = 0; i < queues.size(); ++i)
+      workers.emplace_back([this, i] {
+        currentPool = this;
+        currentWorker = i;
+        while (!stopping) {
+          std::function<void()> task;
+          if (take(i, task)) {
+            task();
+            continue;
+          }
+          std::unique_lock lock(mutex);
+          wake.wait(lock, [this] { return stopping || pending > 0; });
+        }
+      });
+  }
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  // Pops the oldest task of worker i, or steals the newest of another.
+  bool take(size_t i, std::function<void()> &task)
+  {
+    for (size_t k = 0; k < queues.size(); ++k) {
+      Queue &queue = queues[(i + k) % queues.size()];
+      std::lock_guard lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (k == 0) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      --pending; // Under the queue lock, so it never runs ahead of submit
+      return true;
+    }
+    return false;
+  }
+
+  void submit(std::function<void()> task)
+  {
+    size_t i = currentPool == this ? currentWorker
+                                   : nextQueue++ % queues.size();
+    {
+      std::lock_guard lock(queues[i].mutex);
+      queues[i].tasks.push_back(std::move(task));
+      ++pending;
+    }
+    {
+      std::lock_guard lock(mutex); // Not between a worker's check and wait
+    }
+    wake.notify_one();
+  }
+};
+
+// Annotation logs are ANNOTATION_MAGIC followed by AnnotationRecords, each
+// trailed by its text. Each end is anchored to the time of the base bar it
+// lies in, so a log depends neither on the timeframe shown nor on how much
+// history is loaded. A delete removes the most recent annotation of its
+// kind, as the d, r and y keys do.
+constexpr char ANNOTATION_MAGIC[8] = {'C', 'N', 'D', 'L', 'A', 'N', 'N', 2};
+
+enum AnnotationOp : uint8_t {
+  ADD_LINE,
+  ADD_RECT,
+  ADD_TEXT,
+  DELETE_LINE,
+  DELETE_RECT,
+  DELETE_TEXT,
+  NUM_LOGGED_OPS,
+  COMPACT_LOG = NUM_LOGGED_OPS, // Writer requests, never stored
+  EXPORT_JSON
+};
+
+struct AnnotationEnd {
+  int64_t time; // Of the base bar the end lies in
+  float offset; // Bars past the start of that bar
+  float price;
+};
+
+struct AnnotationRecord {
+  uint8_t op; // AnnotationOp
+  uint8_t reserved[5];
+  uint16_t textLength;
+  AnnotationEnd start, end; // A text only has a start
+};
+
+// Anchors base bar coordinate `x` to the bar it lies in, or to the first or
+// last bar if it lies outside the series.
+AnnotationEnd anchorAnnotation(const CandleSeries &base, float x, float price)
+{
+  size_t k = x <= 0.f ? 0 : std::min(base.size() - 1, static_cast<size_t>(x));
+  return {base.time[k], x - static_cast<float>(k), price};
+}
+
+// Returns the base bar coordinate of an anchored end. A time between bars,
+// or outside the series, is placed by the series' average bar spacing.
+float placeAnnotation(const CandleSeries &base, const AnnotationEnd &end)
+{
+  const int64_t *times = base.time.data;
+  size_t n = base.size();
+  size_t k = static_cast<size_t>(std::upper_bound(times, times + n, end.time) -
+                                 times);
+  k = k ? k - 1 : 0; // The last bar at or before the time, else the first
+  float x = static_cast<float>(k) + end.offset;
+  if (times[k] != end.time && n > 1) {
+    double spacing = static_cast<double>(times[n - 1] - times[0]) / (n - 1);
+    x += static_cast<float>((end.time - times[k]) / spacing);
+  }
+  return x;
+}
+
+struct SavedAnnotation {
+  AnnotationRecord record; // The add that created it
+  std::string text;
+};
+
+struct SavedAnnotations {
+  std::vector<SavedAnnotation> lines, rects, texts;
+
+  size_t size() const { return lines.size() + rects.size() + texts.size(); }
+};
+
+// A symbol's annotations as saved, replayed from its log. After loading it
+// belongs to the writer thread, which compacts and exports from it without
+// touching the copies the render loop edits.
+struct AnnotationLog {
+  std::string path;
+  SavedAnnotations saved;
+  size_t numRecords = 0;
+  std::ofstream file; // Opened for appending on the first edit
+};
+
+bool applyAnnotation(SavedAnnotations &saved, const AnnotationRecord &record,
+                     std::string text)
+{
+  switch (record.op) {
+  case ADD_LINE:
+    saved.lines.push_back({record, {}});
+    return true;
+  case ADD_RECT:
+    saved.rects.push_back({record, {}});
+    return true;
+  case ADD_TEXT:
+    saved.texts.push_back({record, std::move(text)});
+    return true;
+  case DELETE_LINE:
+    if (!saved.lines.empty())
+      saved.lines.pop_back();
+    return true;
+  case DELETE_RECT:
+    if (!saved.rects.empty())
+      saved.rects.pop_back();
+    return true;
+  case DELETE_TEXT:
+    if (!saved.texts.empty())
+      saved.texts.pop_back();
+    return true;
+  }
+  return false;
+}
+
+// Replays a log through a read-only mapping. Returns false if the file is
+// damaged, e.g. by a write cut short; the records before the damage are
+// kept.
+bool loadAnnotationLog(AnnotationLog &log)
+{
+  MappedFile mapping(log.path, MADV_SEQUENTIAL);
+  if (!mapping)
+    return true; // Nothing saved yet
+  if (mapping.size < sizeof(ANNOTATION_MAGIC) ||
+      std::memcmp(mapping.data, ANNOTATION_MAGIC, sizeof(ANNOTATION_MAGIC)))
+    return false;
+  const char *cursor = mapping.data + sizeof(ANNOTATION_MAGIC);
+  const char *end = mapping.data + mapping.size;
+  while (cursor < end) {
+    AnnotationRecord record;
+    if (static_cast<size_t>(end - cursor) < sizeof(record))
+      return false;
+    std::memcpy(&record, cursor, sizeof(record));
+    cursor += sizeof(record);
+    if (static_cast<size_t>(end - cursor) < record.textLength ||
+        !applyAnnotation(log.saved, record,
+                         std::string(cursor, record.textLength)))
+      return false;
+    cursor += record.textLength;
+    ++log.numRecords;
+  }
+  return true;
+}
+
+void writeAnnotationRecord(std::ostream &out, AnnotationRecord record,
+                           const std::string &text = {})
+{
+  std::fill(std::begin(record.reserved), std::end(record.reserved), 0);
+  record.textLength = static_cast<uint16_t>(
+      std::min<size_t>(text.size(), std::numeric_limits<uint16_t>::max()));
+  out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  out.write(text.data(), record.textLength);
+}
+
+// Rewrites a log with one record per live annotation, through a temporary
+// file so a crash leaves either the old log or the new one.
+bool compactAnnotationLog(AnnotationLog &log)
+{
+  log.file.close();
+  std::string tempName = log.path + ".tmp";
+  {
+    std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+    out.write(ANNOTATION_MAGIC, sizeof(ANNOTATION_MAGIC));
+    for (const auto *kind : {&log.saved.lines, &log.saved.rects,
+                             &log.saved.texts}) {
+      for (const SavedAnnotation &annotation : *kind)
+        writeAnnotationRecord(out, annotation.record, annotation.text);
+    }
+    if (!out.flush())
+      return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tempName, log.path, ec);
+  if (ec) {
+    std::filesystem::remove(tempName, ec);
+    return false;
+  }
+  log.numRecords = log.saved.size();
+  return true;
+}
+
+std::string quoteJson(const std::string &text)
+{
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// Writes the saved annotations as JSON next to the log. Each end is the
+// time of a base bar in seconds since the epoch plus an offset in bars.
+bool exportAnnotationsJson(const AnnotationLog &log)
+{
+  auto writeEnd = [](std::ostream &out, const char *name,
+                     const AnnotationEnd &end) {
+    out << "\"" << name << "_time\": " << end.time << ", \"" << name
+        << "_offset\": " << end.offset << ", \"" << name
+        << "_price\": " << end.price;
+  };
+  std::ofstream out(log.path + ".json");
+  out << "{\n  \"lines\": [";
+  for (size_t i = 0; i < log.saved.lines.size(); ++i) {
+    const AnnotationRecord &line = log.saved.lines[i].record;
+    out << (i ? ",\n    {" : "\n    {");
+    writeEnd(out, "start", line.start);
+    out << ", ";
+    writeEnd(out, "end", line.end);
+    out << "}";
+  }
+  out << "\n  ],\n  \"rects\": [";
+  for (size_t i = 0; i < log.saved.rects.size(); ++i) {
+    const AnnotationRecord &rect = log.saved.rects[i].record;
+    out << (i ? ",\n    {" : "\n    {");
+    writeEnd(out, "start", rect.start);
+    out << ", ";
+    writeEnd(out, "end", rect.end);
+    out << "}";
+  }
+  out << "\n  ],\n  \"texts\": [";
+  for (size_t i = 0; i < log.saved.texts.size(); ++i) {
+    const SavedAnnotation &text = log.saved.texts[i];
+    out << (i ? ",\n    {" : "\n    {") << "\"time\": "
+        << text.record.start.time << ", \"offset\": "
+        << text.record.start.offset << ", \"price\": "
+        << text.record.start.price << ", \"text\": " << quoteJson(text.text)
+        << "}";
+  }
+  out << "\n  ]\n}" << std::endl;
+  return static_cast<bool>(out);
+}
+
+struct AnnotationEdit {
+  AnnotationLog *log;
+  AnnotationRecord record;
+  std::string text;
+};
+
+// Carries out one queued edit on the writer thread, noting logs appended to.
+void writeAnnotationEdit(AnnotationEdit &edit,
+                         std::vector<AnnotationLog *> &touched)
+{
+  AnnotationLog &log = *edit.log;
+  if (edit.record.op == COMPACT_LOG) {
+    if (!compactAnnotationLog(log))
+      std::cerr << "Failed to compact " << log.path << std::endl;
+    return;
+  }
+  if (edit.record.op == EXPORT_JSON) {
+    if (exportAnnotationsJson(log))
+      std::cout << "Exported annotations to " << log.path << ".json"
+                << std::endl;
+    else
+      std::cerr << "Failed to export " << log.path << ".json" << std::endl;
+    return;
+  }
+  if (!log.file.is_open()) {
+    std::error_code ec;
+    bool fresh = std::filesystem::file_size(log.path, ec) == 0 || ec;
+    log.file.open(log.path, std::ios::binary | std::ios::app);
+    if (fresh)
+      log.file.write(ANNOTATION_MAGIC, sizeof(ANNOTATION_MAGIC));
+  }
+  if (log.file) { // Reported once when it fails
+    writeAnnotationRecord(log.file, edit.record, edit.text);
+    if (!log.file)
+      std::cerr << "Failed to write " << log.path << std::endl;
+  }
+  applyAnnotation(log.saved, edit.record, std::move(edit.text));
+  ++log.numRecords;
+  if (std::find(touched.begin(), touched.end(), &log) == touched.end())
+    touched.push_back(&log);
+}
+
+// Appends queued edits to annotation logs on a background thread, so the
+// render loop only ever takes a lock to queue one. A log is compacted once
+// most of its records are superseded. Pending edits are written before the
+// writer is destroyed.
+struct AnnotationWriter {
+  static constexpr size_t COMPACT_MIN_RECORDS = 1024;
+  std::deque<AnnotationEdit> edits;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread thread;
+
+  AnnotationWriter()
+  {
+    thread = std::thread([this] {
+      std::vector<AnnotationEdit> batch;
+      std::vector<AnnotationLog *> touched;
+      while (true) {
+        {
+          std::unique_lock lock(mutex);
+          wake.wait(lock, [this] { return stopping || !edits.empty(); });
+          if (edits.empty())
+            return;
+          batch.assign(std::make_move_iterator(edits.begin()),
+                       std::make_move_iterator(edits.end()));
+          edits.clear();
+        }
+        touched.clear();
+        for (AnnotationEdit &edit : batch)
+          writeAnnotationEdit(edit, touched);
+        for (AnnotationLog *log : touched) {
+          log->file.flush();
+          if (log->numRecords >= COMPACT_MIN_RECORDS &&
+              log->numRecords > 2 * log->saved.size())
+            compactAnnotationLog(*log);
+        }
+      }
+    });
+  }
+  ~AnnotationWriter()
+  {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+  }
+
+  void submit(AnnotationEdit edit)
+  {
+    {
+      std::lock_guard lock(mutex);
+      edits.push_back(std::move(edit));
+    }
+    wake.notify_one();
+  }
+};
+
+enum SymbolState { SYMBOL_UNLOADED, SYMBOL_LOADING, SYMBOL_READY };
+
+// One chart per symbol. The base series, the timeframes resampled from it
+// and their caches stay resident until evicted; annotations, the view and
+// the timeframe they are in survive eviction.
+struct Symbol {
+  std::string name, path;
+  std::atomic<int> state{SYMBOL_UNLOADED}; // SymbolState
+  std::array<ChartSeries, NUM_TIMEFRAMES> series;
+  size_t bytes = 0; // Resident size of the above
+
+  // Annotations in bars of the timeframe shown, placed from their saved,
+  // date-anchored copies whenever the series changes
+  std::vector<ChartLine> lines;
+  std::vector<ChartRect> rects;
+  std::vector<ChartText> texts;
+  SavedAnnotations savedAnnotations;
+  AnnotationLog annotationLog;
+  Timeframe timeframe = TIMEFRAME_BASE;
+  float viewStart = 0.f, viewEnd = -1.f; // Unset until first shown
+  uint64_t lastUsed = 0;
+
+  // Loads hand their result over here for the main thread to take. A first
+  // load publishes ever longer histories while it parses; `partial` is set
+  // while the main thread shows one of those.
+  std::mutex loadMutex;
+  ChartSeries loaded;
+  bool hasLoaded = false, loadedComplete = false;
+  size_t loadedBytes = 0; // Already counted in the workspace
+  std::atomic<float> loadProgress{0.f};
+  bool partial = false;
+};
+
+struct Workspace {
+  std::vector<std::unique_ptr<Symbol>> symbols;
+  std::atomic<size_t> residentBytes{0};
+  size_t memoryBudget = 0;
+  size_t pageBudget = 0; // Resident bytes of each paged series
+  uint64_t clock = 0; // Last-used stamps for LRU eviction
+  ThreadPool pool{std::thread::hardware_concurrency()};
+};
+
+size_t chartSeriesBytes(const ChartSeries &series)
+{
+  if (series.pages.budgetChunks)
+    return series.pages.budgetChunks * PAGE_CHUNK_BYTES;
+  auto candleBytes = [](const CandleSeries &candles) {
+    return candles.size() * (4 * sizeof(Price) + sizeof(float) +
+                             sizeof(int64_t));
+  };
+  size_t bytes = candleBytes(series.candles) +
+                 series.baseStarts.size() * sizeof(size_t);
+  for (const auto &level : series.pyramid.levels)
+    bytes += candleBytes(level);
+  for (size_t i = 0; i < series.priceIndex.mins.size(); ++i)
+    bytes += 2 * series.priceIndex.mins[i].size() * sizeof(Price);
+  return bytes;
+}
+
+size_t symbolBytes(const Symbol &symbol)
+{
+  size_t bytes = 0;
+  for (const ChartSeries &series : symbol.series)
+    bytes += chartSeriesBytes(series);
+  return bytes;
+}
+
+// Hands a loaded series with its indexes over to the main thread.
+void publishSeries(Workspace &workspace, Symbol &symbol, CandleSeries candles,
+                   bool complete)
+{
+  ChartSeries series;
+  series.candles = std::move(candles);
+  if (!complete || !pageSeries(series, workspace.pageBudget)) {
+    updateCandlePyramid(series.pyramid, series.candles);
+    updateRangeIndex(series.priceIndex, series.candles.low.data,
+                     series.candles.high.data, series.candles.size());
+  }
+  size_t bytes = chartSeriesBytes(series);
+  std::lock_guard lock(symbol.loadMutex);
+  symbol.loaded = std::move(series);
+  symbol.hasLoaded = true;
+  symbol.loadedComplete = complete;
+  symbol.loadedBytes = complete ? bytes : 0;
+  workspace.residentBytes += symbol.loadedBytes;
+}
+
+// Loads the symbol's series and builds its indexes on the calling thread.
+// A progressive load publishes the most recent bars first, then ever longer
+// histories as older rows are parsed.
+void loadSymbol(Workspace &workspace, Symbol &symbol, bool progressive)
+{
+  ParseStats stats;
+  ParseProgress progress;
+  if (progressive)
+    progress = [&workspace, &symbol](
+                   const std::vector<Candlestick> &newestFirst,
+                   float fraction) {
+      CandleSeries candles;
+      candles.reserve(newestFirst.size());
+      for (auto it = newestFirst.rbegin(); it != newestFirst.rend(); ++it)
+        candles.append(*it);
+      publishSeries(workspace, symbol, std::move(candles), false);
+      symbol.loadProgress = fraction;
+    };
+  CandleSeries candles = loadCandles(symbol.path, &stats, progress);
+  size_t numCandles = candles.size();
+  publishSeries(workspace, symbol, std::move(candles), true);
+  symbol.loadProgress = 1.f;
+
+  std::ostringstream message;
+  message << symbol.name << ": " << numCandles << " candles "
+          << (stats.fromCache ? "from cache" : "parsed") << " in "
+          << std::fixed << std::setprecision(1) << stats.seconds * 1000.0
+          << " ms\n";
+  std::cout << message.str() << std::flush;
+  symbol.state.store(SYMBOL_READY, std::memory_order_release);
+}
+
+// Takes the newest series published by the symbol's load, on the main
+// thread. Returns false if there was none.
+bool takeLoadedSeries(Workspace &workspace, Symbol &symbol)
+{
+  std::lock_guard lock(symbol.loadMutex);
+  if (!symbol.hasLoaded)
+    return false;
+  symbol.series = {};
+  symbol.series[TIMEFRAME_BASE] = std::move(symbol.loaded);
+  symbol.loaded = {};
+  symbol.hasLoaded = false;
+  symbol.partial = !symbol.loadedComplete;
+  workspace.residentBytes -= symbol.bytes;
+  symbol.bytes = symbol.loadedBytes;
+  return true;
+}
+
+// Queues a symbol for loading unless it is resident or on its way. Preloads
+// are skipped once the memory budget is used up. Other symbols not shown
+// before load progressively.
+void requestSymbol(Workspace &workspace, Symbol &symbol, bool preload = false)
+{
+  int expected = SYMBOL_UNLOADED;
+  if (!symbol.state.compare_exchange_strong(expected, SYMBOL_LOADING))
+    return;
+  bool progressive = !preload && symbol.viewEnd < 0.f;
+  workspace.pool.submit([&workspace, &symbol, preload, progressive] {
+    if (preload && workspace.residentBytes >= workspace.memoryBudget) {
+      symbol.state = SYMBOL_UNLOADED;
+      return;
+    }
+    loadSymbol(workspace, symbol, progressive);
+  });
+}
+
+// Evicts least recently used symbols until the workspace fits its budget.
+void enforceMemoryBudget(Workspace &workspace, const Symbol *current)
+{
+  while (workspace.residentBytes > workspace.memoryBudget) {
+    Symbol *victim = nullptr;
+    for (auto &symbol : workspace.symbols) {
+      if (symbol.get() != current && symbol->state == SYMBOL_READY &&
+          (!victim || symbol->lastUsed < victim->lastUsed))
+        victim = symbol.get();
+    }
+    if (!victim)
+      return;
+    workspace.residentBytes -= victim->bytes;
+    victim->series = {};
+    victim->bytes = 0;
+    {
+      std::lock_guard lock(victim->loadMutex); // Loaded but never taken
+      if (victim->hasLoaded)
+        workspace.residentBytes -= victim->loadedBytes;
+      victim->loaded = {};
+      victim->hasLoaded = false;
+    }
+    victim->state = SYMBOL_UNLOADED;
+  }
+}
+
+// The series of the symbol's timeframe, resampling whatever changed in the
+// base series since it was last shown.
+ChartSeries &currentSeries(Workspace &workspace, Symbol &symbol)
+{
+  ChartSeries &series = symbol.series[symbol.timeframe];
+  if (symbol.timeframe == TIMEFRAME_BASE || series.staleFrom == SIZE_MAX)
+    return series;
+  resampleSeries(series, symbol.series[TIMEFRAME_BASE].candles,
+                 symbol.timeframe, series.staleFrom);
+  workspace.residentBytes -= symbol.bytes;
+  symbol.bytes = symbolBytes(symbol);
+  workspace.residentBytes += symbol.bytes;
+  return series;
+}
+
+// Switches a symbol to another timeframe, moving its annotations and the
+// view [viewStart, viewEnd] so they stay on the same dates.
+void switchTimeframe(Workspace &workspace, Symbol &symbol, Timeframe timeframe,
+                     float &viewStart, float &viewEnd)
+{
+  size_t baseSize = symbol.series[TIMEFRAME_BASE].candles.size();
+  const ChartSeries &from = symbol.series[symbol.timeframe];
+  symbol.timeframe = timeframe;
+  const ChartSeries &to = currentSeries(workspace, symbol);
+  auto remap = [&](float &x) {
+    x = fromBaseCoordinate(to, baseSize, toBaseCoordinate(from, baseSize, x));
+  };
+  for (ChartLine &line : symbol.lines) {
+    remap(line.startCandle);
+    remap(line.endCandle);
+  }
+  for (ChartRect &rect : symbol.rects) {
+    remap(rect.startCandle);
+    remap(rect.endCandle);
+  }
+  for (ChartText &text : symbol.texts)
+    remap(text.candle);
+  float viewLimit = viewEnd + 1; // The last bar counts to its end
+  remap(viewStart);
+  remap(viewLimit);
+  viewEnd = viewLimit - 1;
+}
+
+// Loads the annotations saved for a symbol. A damaged log, or one mostly
+// made of superseded records, is queued for rewriting.
+void loadAnnotations(AnnotationWriter &writer, Symbol &symbol)
+{
+  AnnotationLog &log = symbol.annotationLog;
+  log.path = (symbol.path.empty() ? symbol.name : symbol.path) + ".annotations";
+  bool intact = loadAnnotationLog(log);
+  if (!intact)
+    std::cerr << "Recovered what was readable from " << log.path << std::endl;
+  symbol.savedAnnotations = log.saved;
+  if (!intact || (log.numRecords >= AnnotationWriter::COMPACT_MIN_RECORDS &&
+                  log.numRecords > 2 * log.saved.size()))
+    writer.submit({&log, {COMPACT_LOG, {}, 0, {}, {}}, {}});
+}
+
+// Places the saved annotations in bars of the symbol's timeframe. Called
+// whenever its base series is replaced.
+void placeAnnotations(Workspace &workspace, Symbol &symbol)
+{
+  symbol.lines.clear();
+  symbol.rects.clear();
+  symbol.texts.clear();
+  const CandleSeries &base = symbol.series[TIMEFRAME_BASE].candles;
+  if (base.empty())
+    return;
+  const ChartSeries &series = currentSeries(workspace, symbol);
+  auto place = [&](const AnnotationEnd &end) {
+    return fromBaseCoordinate(series, base.size(),
+                              placeAnnotation(base, end));
+  };
+  for (const SavedAnnotation &line : symbol.savedAnnotations.lines)
+    symbol.lines.push_back({place(line.record.start), line.record.start.price,
+                            place(line.record.end), line.record.end.price});
+  for (const SavedAnnotation &rect : symbol.savedAnnotations.rects)
+    symbol.rects.push_back({place(rect.record.start), rect.record.start.price,
+                            place(rect.record.end), rect.record.end.price});
+  for (const SavedAnnotation &text : symbol.savedAnnotations.texts)
+    symbol.texts.push_back(
+        {place(text.record.start), text.record.start.price, text.text});
+}
+
+// Queues an annotation edit for saving, with bar coordinates in the
+// symbol's timeframe anchored to the times of base bars.
+void saveAnnotation(AnnotationWriter &writer, Symbol &symbol,
+                    AnnotationOp op, float startCandle = 0.f,
+                    float startPrice = 0.f, float endCandle = 0.f,
+                    float endPrice = 0.f, std::string text = {})
+{
+  AnnotationRecord record{op, {}, 0, {}, {}};
+  const CandleSeries &base = symbol.series[TIMEFRAME_BASE].candles;
+  if (op < DELETE_LINE) {
+    const ChartSeries &series = symbol.series[symbol.timeframe];
+    auto anchor = [&](float x, float price) {
+      return anchorAnnotation(
+          base, toBaseCoordinate(series, base.size(), x), price);
+    };
+    record.start = anchor(startCandle, startPrice);
+    record.end = anchor(endCandle, endPrice);
+  }
+  if (op < NUM_LOGGED_OPS)
+    applyAnnotation(symbol.savedAnnotations, record, text);
+  writer.submit({&symbol.annotationLog, record, std::move(text)});
+}
+
+std::string symbolTitle(const Symbol &symbol)
+{
+  std::string title = "Candlesticks - " + symbol.name;
+  if (symbol.timeframe != TIMEFRAME_BASE)
+    title += std::string(" (") + TIMEFRAME_NAMES[symbol.timeframe] + ")";
+  return title;
+}
+
+// Expands directories into the CSV files they contain, sorted by name.
+std::vector<std::string> findSymbolFiles(const std::vector<std::string> &paths)
+{
+  std::vector<std::string> files;
+  for (const auto &path : paths) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+      files.push_back(path);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(path, error)) {
+      if (entry.is_regular_file(error) && entry.path().extension() == ".csv")
+        found.push_back(entry.path().string());
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  return files;
+}
+
+// Headless screener: every filter is tested on the last bar of each CSV,
+// and the symbols passing all of them are reported.
+enum ScreenFilterKind {
+  FILTER_NEW_HIGH,     // Highest high of the last `bars` bars
+  FILTER_CHANGE,       // Close moved `threshold` percent over `bars` bars
+  FILTER_VOLUME_SPIKE, // Volume `threshold` times its `bars`-bar average
+  FILTER_CROSS_ABOVE,
+  FILTER_CROSS_BELOW
 };
 
-struct ChartRect {
-  float startCandle, startPrice, endCandle, endPrice;
+enum OperandKind { OPERAND_CLOSE, OPERAND_INDICATOR, OPERAND_CONSTANT };
+
+// One side of a cross: the close, the first line of an indicator, or a
+// constant level.
+struct ScreenOperand {
+  OperandKind kind = OPERAND_CLOSE;
+  size_t indicator = 0;
+  float value = 0.f;
 };
 
-struct ChartText {
-  float candle, price;
-  std::string text;
+struct ScreenFilter {
+  ScreenFilterKind kind;
+  size_t bars = 1;
+  float threshold = 0.f;
+  ScreenOperand a, b;
 };
 
-std::vector<Candlestick> parseData(const std::string &filename)
+// Parses "close", a number, or an indicator name without spaces such as
+// "SMA50" or "RSI14". A unique prefix will do, so "MACD" names
+// "MACD 12,26,9".
+bool parseScreenOperand(const std::string &text, ScreenOperand &operand)
 {
-  std::ifstream file(filename);
-  if (!file.is_open()) {
-    std::cerr << "Failed to open file: " << filename << std::endl;
-    return {};
+  auto compact = [](const char *name) {
+    std::string key;
+    for (const char *c = name; *c; ++c) {
+      if (*c != ' ')
+        key += static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+    }
+    return key;
+  };
+  std::string key = compact(text.c_str());
+  if (key == "CLOSE") {
+    operand.kind = OPERAND_CLOSE;
+    return true;
   }
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  std::string content = buffer.str();
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, operand.value);
+  if (ec == std::errc() && ptr == end) {
+    operand.kind = OPERAND_CONSTANT;
+    return true;
+  }
+  size_t matches = 0;
+  for (size_t i = 0; i < NUM_INDICATORS; ++i) {
+    std::string name = compact(INDICATORS[i].name);
+    if (name == key) {
+      matches = 1;
+      operand.indicator = i;
+      break;
+    }
+    if (name.rfind(key, 0) == 0) {
+      ++matches;
+      operand.indicator = i;
+    }
+  }
+  operand.kind = OPERAND_INDICATOR;
+  return !key.empty() && matches == 1;
+}
 
-  std::vector<Candlestick> candles;
-  std::stringstream ss(content);
-  std::string line;
-  std::getline(ss, line); // Skip header
-  while (std::getline(ss, line)) {
-    std::stringstream ls(line);
-    std::string date, close, volume, open, high, low;
-    std::getline(ls, date, ',');
-    std::getline(ls, close, ',');
-    std::getline(ls, volume, ',');
-    std::getline(ls, open, ',');
-    std::getline(ls, high, ',');
-    std::getline(ls, low, ',');
-    Candlestick candle;
-    candle.date = date;
-    candle.close = std::stof(close.substr(1));
-    candle.volume = std::stof(volume);
-    candle.open = std::stof(open.substr(1));
-    candle.high = std::stof(high.substr(1));
-    candle.low = std::stof(low.substr(1));
-    candles.push_back(candle);
+// Parses the value of a filter flag: "DAYS" for --new-high, "PCT[:BARS]"
+// for --change, "MULTIPLE[:BARS]" for --volume-spike and "A:B" for the
+// crosses.
+bool parseScreenFilter(const std::string &flag, const std::string &value,
+                       ScreenFilter &filter)
+{
+  size_t colon = value.find(':');
+  std::string first = value.substr(0, colon);
+  std::string second = colon == std::string::npos ? "" : value.substr(colon + 1);
+  auto parseBars = [&](size_t fallback) {
+    filter.bars = second.empty() ? fallback
+                                 : std::strtoull(second.c_str(), nullptr, 10);
+    return filter.bars > 0;
+  };
+  auto parseThreshold = [&] {
+    const char *end = first.data() + first.size();
+    auto [ptr, ec] = std::from_chars(first.data(), end, filter.threshold);
+    return !first.empty() && ec == std::errc() && ptr == end;
+  };
+  if (flag == "--new-high") {
+    filter.kind = FILTER_NEW_HIGH;
+    filter.bars = std::strtoull(value.c_str(), nullptr, 10);
+    return filter.bars > 0;
   }
-  return candles;
+  if (flag == "--change") {
+    filter.kind = FILTER_CHANGE;
+    return parseThreshold() && parseBars(1);
+  }
+  if (flag == "--volume-spike") {
+    filter.kind = FILTER_VOLUME_SPIKE;
+    return parseThreshold() && parseBars(20);
+  }
+  filter.kind =
+      flag == "--cross-above" ? FILTER_CROSS_ABOVE : FILTER_CROSS_BELOW;
+  return parseScreenOperand(first, filter.a) &&
+         parseScreenOperand(second, filter.b);
 }
 
-void drawCandlesticks(sf::RenderWindow &window,
-                      const std::vector<Candlestick> &candles, float viewStart,
-                      float viewEnd, float marginX, float chartTop,
-                      float chartHeight, float candleWidth, float spacing,
-                      float viewMinPrice, float viewMaxPrice)
+float operandValue(const ScreenOperand &operand, const CandleSeries &candles,
+                   IndicatorSet &indicators, size_t i)
 {
-  float viewPriceRange = viewMaxPrice - viewMinPrice;
-  for (size_t i = static_cast<size_t>(viewStart);
-       i <= static_cast<size_t>(viewEnd); ++i) {
-    const auto &candle = candles[i];
-    float x = marginX + ((i - viewStart) * (candleWidth + spacing));
-    float highY = chartTop +
-                  ((viewMaxPrice - candle.high) / viewPriceRange * chartHeight);
-    float lowY =
-        chartTop + ((viewMaxPrice - candle.low) / viewPriceRange * chartHeight);
-    float openY = chartTop +
-                  ((viewMaxPrice - candle.open) / viewPriceRange * chartHeight);
-    float closeY = chartTop + ((viewMaxPrice - candle.close) / viewPriceRange *
-                               chartHeight);
-
-    sf::RectangleShape wick({1, lowY - highY});
-    wick.setPosition({x + candleWidth / 2, highY});
-    wick.setFillColor(sf::Color::Black);
-    window.draw(wick);
-
-    float bodyHeight = std::abs(openY - closeY);
-    float bodyY = std::min(openY, closeY);
-    sf::RectangleShape body({candleWidth, bodyHeight});
-    body.setPosition({x + 0.5f, bodyY});
-    body.setFillColor(candle.close >= candle.open ? sf::Color::Green
-                                                  : sf::Color::Red);
-    window.draw(body);
-  }
-}
-
-void drawDateLabels(sf::RenderWindow &window,
-                    const std::vector<Candlestick> &candles, float viewStart,
-                    float viewEnd, float marginX, float chartBottom,
-                    float chartWidth, float candleWidth, float spacing,
-                    const sf::Font &font)
+  switch (operand.kind) {
+  case OPERAND_CLOSE:
+    return fromPrice(candles.close[i]);
+  case OPERAND_INDICATOR:
+    updateIndicator(indicators, operand.indicator, candles);
+    return indicators.indicators[operand.indicator].lines[0][i];
+  case OPERAND_CONSTANT:
+    break;
+  }
+  return operand.value;
+}
+
+// Whether the last bar of `candles` passes `filter`. Indicators are
+// computed on first use.
+bool passesFilter(const ScreenFilter &filter, const CandleSeries &candles,
+                  IndicatorSet &indicators)
 {
-  float viewWidth = viewEnd - viewStart + 1;
-  size_t numLabels = static_cast<size_t>(viewWidth);
-  size_t step =
-      std::max<size_t>(1, numLabels / std::max<size_t>(1, chartWidth / 50));
-  for (size_t i = static_cast<size_t>(viewStart);
-       i <= static_cast<size_t>(viewEnd); i += step) {
-    const auto &candle = candles[i];
-    float x = marginX + ((i - viewStart) * (candleWidth + spacing));
-    sf::Text dateText(font, candle.date, 12);
-    dateText.setFillColor(sf::Color::Black);
-    dateText.setRotation(sf::degrees(45));
-    sf::FloatRect bounds = dateText.getLocalBounds();
-    dateText.setOrigin({bounds.size.x / 2, 0});
-    dateText.setPosition({x + candleWidth / 2, chartBottom + 50});
-    window.draw(dateText);
+  size_t n = candles.size();
+  size_t last = n - 1;
+  switch (filter.kind) {
+  case FILTER_NEW_HIGH: {
+    if (n < filter.bars)
+      return false;
+    Price low, high;
+    columnMinMax(candles.high.data, candles.high.data, n - filter.bars, last,
+                 low, high);
+    return candles.high[last] >= high;
+  }
+  case FILTER_CHANGE: {
+    if (n <= filter.bars)
+      return false;
+    float from = fromPrice(candles.close[last - filter.bars]);
+    float change = (fromPrice(candles.close[last]) / from - 1.f) * 100.f;
+    return from > 0.f && (filter.threshold < 0.f ? change <= filter.threshold
+                                                 : change >= filter.threshold);
+  }
+  case FILTER_VOLUME_SPIKE: {
+    if (n <= filter.bars)
+      return false;
+    double total = 0.0;
+    for (size_t i = last - filter.bars; i < last; ++i)
+      total += candles.volume[i];
+    double average = total / filter.bars;
+    return average > 0.0 && candles.volume[last] >= filter.threshold * average;
   }
+  case FILTER_CROSS_ABOVE:
+  case FILTER_CROSS_BELOW: {
+    if (n < 2)
+      return false;
+    float a0 = operandValue(filter.a, candles, indicators, last - 1);
+    float a1 = operandValue(filter.a, candles, indicators, last);
+    float b0 = operandValue(filter.b, candles, indicators, last - 1);
+    float b1 = operandValue(filter.b, candles, indicators, last);
+    return filter.kind == FILTER_CROSS_ABOVE ? a0 <= b0 && a1 > b1
+                                             : a0 >= b0 && a1 < b1;
+  }
+  }
+  return false;
 }
 
-void drawGridLines(sf::RenderWindow &window, float viewStart, float viewEnd,
-                   float marginX, float chartTop, float chartWidth,
-                   float chartHeight, float candleWidth, float spacing,
-                   float viewMinPrice, float viewMaxPrice)
+struct ScreenMatch {
+  std::string symbol;
+  int64_t time;
+  float close, change, volume; // Change from the previous close, in percent
+};
+
+struct ScreenStats {
+  std::atomic<size_t> files{0}, bars{0};
+};
+
+// Parses a CSV into `candles` on the calling thread as a single chunk.
+// The screener already runs one file per core, so parseData's threads
+// would only oversubscribe them.
+void parseScreenedFile(const std::string &path, CandleSeries &candles)
 {
-  float viewPriceRange = viewMaxPrice - viewMinPrice;
-  float priceStep = viewPriceRange / (NUM_HORIZONTAL_GRID_LINES - 1);
-  // Horizontal grid lines
-  for (int i = 0; i < NUM_HORIZONTAL_GRID_LINES; ++i) {
-    float price = viewMinPrice + i * priceStep;
-    float y =
-        chartTop + ((viewMaxPrice - price) / viewPriceRange * chartHeight);
-    sf::Vertex line[] = {{{marginX, y}, LIGHT_GRAY},
-                         {{marginX + chartWidth, y}, LIGHT_GRAY}};
-    window.draw(line, 2, sf::PrimitiveType::Lines);
+  MappedFile file(path, MADV_SEQUENTIAL);
+  if (!file) {
+    std::cerr << "Failed to open file: " << path << std::endl;
+    return;
   }
-  // Vertical grid lines
-  for (size_t i = static_cast<size_t>(viewStart);
-       i <= static_cast<size_t>(viewEnd); ++i) {
-    float x =
-        marginX + ((i - viewStart) * (candleWidth + spacing)) + candleWidth / 2;
-    sf::Vertex line[] = {{{x, chartTop}, LIGHT_GRAY},
-                         {{x, chartTop + chartHeight}, LIGHT_GRAY}};
-    window.draw(line, 2, sf::PrimitiveType::Lines);
+  const char *begin = file.data;
+  const char *end = file.data + file.size;
+  if (file.size >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+    begin += 3; // UTF-8 byte order mark
+  const char *body;
+  const CsvFormat *format = detectFormat(begin, end, body);
+  if (!format) {
+    std::cerr << path << ": unrecognized CSV format" << std::endl;
+    return;
   }
+  int64_t firstTime, lastTime;
+  bool newestFirst = edgeRowTime(*format, body, end, false, firstTime) &&
+                     edgeRowTime(*format, body, end, true, lastTime) &&
+                     firstTime > lastTime;
+  ParseChunk chunk;
+  format->parseChunk(body, end, chunk);
+  if (!chunk.errors.empty())
+    std::cerr << path << ":" << (body == begin ? 1 : 2) + chunk.errors[0].line
+              << ": " << chunk.errors[0].message << " ("
+              << chunk.errors.size() << " malformed lines skipped)"
+              << std::endl;
+  size_t n = chunk.candles.size();
+  candles.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    candles.append(chunk.candles[newestFirst ? n - 1 - i : i]);
 }
 
-void drawLines(sf::RenderWindow &window, const std::vector<ChartLine> &lines,
-               float viewStart, float viewEnd, float marginX, float chartTop,
-               float chartWidth, float chartHeight, float viewMinPrice,
-               float viewMaxPrice)
+// Screens one CSV, read from its cache when that is current. No cache is
+// written and the series is dropped on return, so a worker holds one
+// series at a time.
+std::optional<ScreenMatch> screenFile(const std::string &path,
+                                      const std::vector<ScreenFilter> &filters,
+                                      ScreenStats &stats)
 {
-  float viewWidth = viewEnd - viewStart + 1;
-  float viewPriceRange = viewMaxPrice - viewMinPrice;
-  for (const auto &line : lines) {
-    float startX =
-        marginX + ((line.startCandle - viewStart) / viewWidth) * chartWidth;
-    float startY = chartTop + ((viewMaxPrice - line.startPrice) /
-                               viewPriceRange * chartHeight);
-    float endX =
-        marginX + ((line.endCandle - viewStart) / viewWidth) * chartWidth;
-    float endY = chartTop + ((viewMaxPrice - line.endPrice) / viewPriceRange *
-                             chartHeight);
-    sf::Vertex lineVertices[] = {{{startX, startY}, sf::Color::Blue},
-                                 {{endX, endY}, sf::Color::Blue}};
-    window.draw(lineVertices, 2, sf::PrimitiveType::Lines);
+  CandleSeries candles;
+  SourceInfo source;
+  if (!statSource(path, source)) {
+    std::cerr << "Failed to open file: " << path << std::endl;
+    return {};
+  }
+  if (!mapCandleCache(path + ".cache", source, candles))
+    parseScreenedFile(path, candles);
+  ++stats.files;
+  stats.bars += candles.size();
+  if (candles.empty())
+    return {};
+  IndicatorSet indicators;
+  for (const ScreenFilter &filter : filters) {
+    if (!passesFilter(filter, candles, indicators))
+      return {};
   }
+  size_t last = candles.size() - 1;
+  float close = fromPrice(candles.close[last]);
+  float previous = last ? fromPrice(candles.close[last - 1]) : close;
+  return ScreenMatch{std::filesystem::path(path).stem().string(),
+                     candles.time[last], close,
+                     previous > 0.f ? (close / previous - 1.f) * 100.f : 0.f,
+                     candles.volume[last]};
 }
 
-void drawRectangles(sf::RenderWindow &window,
-                    const std::vector<ChartRect> &rects, float viewStart,
-                    float viewEnd, float marginX, float chartTop,
-                    float chartWidth, float chartHeight, float viewMinPrice,
-                    float viewMaxPrice)
+// Screens every CSV under `paths` on all cores and writes the matches as
+// JSON if `outputPath` ends in ".json", or as CSV (to stdout when empty).
+int runScreener(const std::vector<std::string> &paths,
+                const std::vector<ScreenFilter> &filters,
+                const std::string &outputPath)
 {
-  float viewWidth = viewEnd - viewStart + 1;
-  float viewPriceRange = viewMaxPrice - viewMinPrice;
-  for (const auto &rect : rects) {
-    float startX =
-        marginX + ((rect.startCandle - viewStart) / viewWidth) * chartWidth;
-    float startY = chartTop + ((viewMaxPrice - rect.startPrice) /
-                               viewPriceRange * chartHeight);
-    float endX =
-        marginX + ((rect.endCandle - viewStart) / viewWidth) * chartWidth;
-    float endY = chartTop + ((viewMaxPrice - rect.endPrice) / viewPriceRange *
-                             chartHeight);
-    sf::RectangleShape rectangle;
-    rectangle.setPosition({std::min(startX, endX), std::min(startY, endY)});
-    rectangle.setSize({std::abs(endX - startX), std::abs(endY - startY)});
-    rectangle.setFillColor(sf::Color(0, 0, 0, 51));
-    rectangle.setOutlineColor(sf::Color::Black);
-    rectangle.setOutlineThickness(1);
-    window.draw(rectangle);
+  auto startTime = std::chrono::steady_clock::now();
+  std::vector<std::string> files = findSymbolFiles(paths);
+  std::vector<std::optional<ScreenMatch>> results(files.size());
+  ScreenStats stats;
+  {
+    std::latch done(static_cast<std::ptrdiff_t>(files.size()));
+    ThreadPool pool(std::thread::hardware_concurrency());
+    for (size_t i = 0; i < files.size(); ++i)
+      pool.submit([&, i] {
+        results[i] = screenFile(files[i], filters, stats);
+        done.count_down();
+      });
+    done.wait();
+  }
+
+  std::ofstream file;
+  if (!outputPath.empty()) {
+    file.open(outputPath);
+    if (!file) {
+      std::cerr << "Failed to write " << outputPath << std::endl;
+      return 1;
+    }
   }
+  std::ostream &out = outputPath.empty() ? std::cout : file;
+  bool json = outputPath.size() >= 5 &&
+              outputPath.compare(outputPath.size() - 5, 5, ".json") == 0;
+  size_t numMatches = 0;
+  out << (json ? "[" : "symbol,date,close,change,volume\n");
+  for (const auto &result : results) {
+    if (!result)
+      continue;
+    if (json)
+      out << (numMatches ? ",\n  " : "\n  ") << "{\"symbol\": "
+          << quoteJson(result->symbol) << ", \"date\": \""
+          << formatDate(result->time) << "\", \"close\": " << result->close
+          << ", \"change\": " << result->change
+          << ", \"volume\": " << result->volume << "}";
+    else
+      out << result->symbol << ',' << formatDate(result->time) << ','
+          << result->close << ',' << result->change << ','
+          << result->volume << '\n';
+    ++numMatches;
+  }
+  if (json)
+    out << "\n]" << std::endl;
+  out.flush();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - startTime)
+                       .count();
+  std::cerr << "Screened " << stats.files << " files (" << stats.bars
+            << " bars) in " << std::fixed << std::setprecision(1)
+            << seconds * 1000.0 << " ms: " << numMatches << " matches"
+            << std::endl;
+  return out ? 0 : 1;
 }
 
-void drawTexts(sf::RenderWindow &window, const std::vector<ChartText> &texts,
-               float viewStart, float viewEnd, float marginX, float chartTop,
-               float chartWidth, float chartHeight, float viewMinPrice,
-               float viewMaxPrice, const sf::Font &font)
+// Random-walk daily bars with a fixed seed, so runs are comparable.
+CandleSeries generateRandomWalk(size_t count, uint32_t seed = 42)
 {
-  float viewWidth = viewEnd - viewStart + 1;
-  float viewPriceRange = viewMaxPrice - viewMinPrice;
-  for (const auto &text : texts) {
-    float x = marginX + ((text.candle - viewStart) / viewWidth) * chartWidth;
-    float y =
-        chartTop + ((viewMaxPrice - text.price) / viewPriceRange * chartHeight);
-    sf::Text textObj(font, text.text, 16);
-    textObj.setFillColor(sf::Color::Black);
-    textObj.setPosition({x, y});
-    window.draw(textObj);
+  CandleSeries series;
+  series.reserve(count);
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> step(0.f, 0.02f);
+  std::uniform_real_distribution<float> range(0.f, 0.02f);
+  std::uniform_real_distribution<float> volume(1e6f, 9e7f);
+  float price = 100.f;
+  for (size_t i = 0; i < count; ++i) {
+    Candlestick candle;
+    candle.open = price;
+    candle.close = std::clamp(price * (1.f + step(rng)), 1.f, 10000.f);
+    candle.high = std::max(candle.open, candle.close) * (1.f + range(rng));
+    candle.low = std::min(candle.open, candle.close) * (1.f - range(rng));
+    candle.volume = std::round(volume(rng));
+    candle.time = static_cast<int64_t>(i) * SECONDS_PER_DAY;
+    price = candle.close;
+    series.append(candle);
   }
+  return series;
 }
 
-int main()
+// Writes a series as a NASDAQ CSV, newest first.
+bool writeNasdaqCsv(const std::string &filename, const CandleSeries &series)
 {
-  auto candles = parseData("./NVDA.csv");
-  if (candles.empty()) {
-    std::cerr << "No data loaded. Exiting." << std::endl;
-    return 1;
+  std::FILE *file = std::fopen(filename.c_str(), "w");
+  if (!file)
+    return false;
+  std::fputs("Date,Close/Last,Volume,Open,High,Low\n", file);
+  for (size_t i = series.size(); i-- > 0;) {
+    Candlestick candle = series.at(i);
+    std::fprintf(file, "%s,$%.2f,%.0f,$%.2f,$%.2f,$%.2f\n",
+                 formatDate(candle.time).c_str(), candle.close,
+                 candle.volume, candle.open, candle.high, candle.low);
   }
-  std::reverse(candles.begin(), candles.end());
+  return std::fclose(file) == 0;
+}
 
-  // Window setup
+double percentile(std::vector<double> values, double fraction)
+{
+  if (values.empty())
+    return 0.0;
+  auto nth = values.begin() + static_cast<ptrdiff_t>(
+                                  fraction * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+// Scripted view sequence for the benchmark: zoom in on the middle from the
+// full view, pan left, then zoom back out.
+std::vector<std::pair<float, float>> benchmarkViews(size_t numCandles)
+{
+  constexpr int STEPS = 100;
+  std::vector<std::pair<float, float>> views;
+  float last = static_cast<float>(numCandles - 1);
+  float width = static_cast<float>(numCandles);
+  float center = last / 2;
+  float minWidth = std::min(width, 100.f);
+  float zoom = std::pow(minWidth / width, 1.f / STEPS);
+  for (int i = 0; i <= STEPS; ++i, width *= zoom)
+    views.push_back({std::max(0.f, center - width / 2),
+                     std::min(last, center + width / 2 - 1)});
+  width = views.back().second - views.back().first + 1;
+  float start = views.back().first;
+  for (int i = 0; i < STEPS; ++i) {
+    start = std::max(0.f, start - width * 0.1f);
+    views.push_back({start, start + width - 1});
+  }
+  for (int i = 0; i < STEPS; ++i) {
+    width = std::min(static_cast<float>(numCandles), width / zoom);
+    start = std::clamp(start - width * (1 - zoom) / 2, 0.f,
+                       static_cast<float>(numCandles) - width);
+    views.push_back({start, start + width - 1});
+  }
+  return views;
+}
+
+void writeStatsJson(std::ostream &out, const char *name,
+                    const std::vector<double> &values)
+{
+  out << "\"" << name << "\": {\"p50\": " << percentile(values, 0.5)
+      << ", \"p99\": " << percentile(values, 0.99) << "}";
+}
+
+// Times parsing, index builds, view min/max, hit testing and off-screen
+// frame rendering over synthetic series, writing JSON to `out`. Frames are
+// drawn as the window draws them, with every indicator, the volume profile,
+// annotations and the profiler HUD shown.
+int runBenchmark(const std::vector<size_t> &sizes, const sf::Font &font,
+                 size_t volumeBuckets, std::ostream &out)
+{
+  constexpr size_t NUM_ANNOTATIONS = 64; // Of each kind
+  using Clock = std::chrono::steady_clock;
+  auto elapsedMs = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
   unsigned width = 1400, height = 800;
-  sf::RenderWindow window(sf::VideoMode({width, height}), "Candlesticks");
+  sf::RenderTexture target({width, height});
+  const float marginX = width * MARGIN_X_PERCENT;
+  const float chartWidth = width - 2 * marginX;
+  const float chartTop = height * MARGIN_Y_PERCENT;
+  const float chartHeight = height - 4 * chartTop;
+  std::string csvName =
+      (std::filesystem::temp_directory_path() / "candlesticks-bench.csv")
+          .string();
+  ChartLayers layers({width, height}, font, volumeBuckets);
+  sf::Sprite chartSprite(layers.chart.getTexture());
+  sf::Sprite annotationSprite(layers.annotations.getTexture());
+  std::array<bool, NUM_INDICATORS> indicatorsShown;
+  indicatorsShown.fill(true);
+  sf::Text profilerText(font, "", 12);
+  profilerText.setFillColor(sf::Color::White);
+  sf::RectangleShape profilerBackground;
+  profilerBackground.setFillColor(sf::Color(0, 0, 0, 180));
+  sf::VertexArray sparkline;
+  frameProfiler.enabled = true;
+  countingAllocations = true;
+
+  out << std::fixed << std::setprecision(4) << "{\"benchmarks\": [";
+  for (size_t s = 0; s < sizes.size(); ++s) {
+    size_t count = std::max<size_t>(sizes[s], 2);
+    std::cerr << "Benchmarking " << count << " bars" << std::endl;
+    ChartSeries shown;
+    CandleSeries &series = shown.candles;
+    series = generateRandomWalk(count);
+
+    ParseStats parseStats;
+    if (!writeNasdaqCsv(csvName, series)) {
+      std::cerr << "Failed to write " << csvName << std::endl;
+      return 1;
+    }
+    parseData(csvName, &parseStats);
+    std::filesystem::remove(csvName);
+
+    auto start = Clock::now();
+    updateCandlePyramid(shown.pyramid, series);
+    updateRangeIndex(shown.priceIndex, series.low.data, series.high.data,
+                     series.size());
+    double indexMs = elapsedMs(start);
+
+    // Annotations spread evenly over the series and its price range
+    std::vector<ChartLine> lines;
+    std::vector<ChartRect> rects;
+    std::vector<ChartText> texts;
+    Price lowest, highest;
+    queryPriceRange(shown, 0, count - 1, lowest, highest);
+    float low = fromPrice(lowest), high = fromPrice(highest);
+    for (size_t i = 0; i < NUM_ANNOTATIONS; ++i) {
+      float x = static_cast<float>(count) * i / NUM_ANNOTATIONS;
+      float price = low + (high - low) * i / NUM_ANNOTATIONS;
+      float span = static_cast<float>(count) / NUM_ANNOTATIONS;
+      lines.push_back({x, price, x + span, high - price + low});
+      rects.push_back({x, price, x + span / 2, price + (high - low) / 20});
+      texts.push_back({x, price, "Note " + std::to_string(i)});
+    }
+
+    std::vector<double> minMaxUs, hitTestUs, frameMs, allocations;
+    std::vector<std::pair<float, float>> views = benchmarkViews(count);
+    // An untimed first frame computes the indicators, which views reuse
+    views.insert(views.begin(), views.front());
+    for (size_t v = 0; v < views.size(); ++v) {
+      auto [viewStart, viewEnd] = views[v];
+      beginFrame(frameProfiler);
+      uint64_t allocationsBefore = heapAllocations.load();
+      auto frameStart = Clock::now();
+
+      start = Clock::now();
+      Price minPrice, maxPrice;
+      queryPriceRange(shown, static_cast<size_t>(viewStart),
+                      static_cast<size_t>(viewEnd), minPrice, maxPrice);
+      float viewMinPrice = fromPrice(minPrice);
+      float viewMaxPrice = fromPrice(maxPrice);
+      double minMaxTime = elapsedMs(start);
+
+      start = Clock::now();
+      float totalWidthPerCandle = chartWidth / (viewEnd - viewStart + 1);
+      sf::Vector2f mouse(marginX + chartWidth / 2, chartTop + chartHeight / 2);
+      hitTestCandle(series, mouse, viewStart, viewEnd, marginX, chartTop,
+                    chartHeight, totalWidthPerCandle * CANDLE_WIDTH_FACTOR,
+                    totalWidthPerCandle * SPACING_FACTOR, viewMinPrice,
+                    viewMaxPrice);
+      double hitTestTime = elapsedMs(start);
+
+      renderChartLayer(layers, shown, indicatorsShown, true, viewStart,
+                       viewEnd, marginX, chartTop, chartWidth, chartHeight,
+                       viewMinPrice, viewMaxPrice);
+      renderAnnotationLayer(layers, lines, rects, texts, v == 0, viewStart,
+                            viewEnd, marginX, chartTop, chartWidth,
+                            chartHeight, viewMinPrice, viewMaxPrice);
+      target.clear(sf::Color::White);
+      submitDraw(target, chartSprite);
+      submitDraw(target, annotationSprite);
+      drawProfilerHud(target, profilerText, profilerBackground, sparkline,
+                      frameProfiler, static_cast<float>(width));
+      target.display();
+      double frameTime = elapsedMs(frameStart);
+      uint64_t frameAllocations = heapAllocations.load() - allocationsBefore;
+      endFrame(frameProfiler);
+      if (v == 0)
+        continue;
+      minMaxUs.push_back(minMaxTime * 1000.0);
+      hitTestUs.push_back(hitTestTime * 1000.0);
+      frameMs.push_back(frameTime);
+      allocations.push_back(static_cast<double>(frameAllocations));
+    }
+
+    out << (s ? ", " : "") << "{\"bars\": " << count
+        << ", \"parse_ms\": " << parseStats.seconds * 1000.0
+        << ", \"parse_mb_per_s\": " << parseStats.megabytesPerSecond()
+        << ", \"index_build_ms\": " << indexMs << ", \"frames\": "
+        << frameMs.size() << ", ";
+    writeStatsJson(out, "minmax_us", minMaxUs);
+    out << ", ";
+    writeStatsJson(out, "hit_test_us", hitTestUs);
+    out << ", ";
+    writeStatsJson(out, "frame_ms", frameMs);
+    out << ", ";
+    writeStatsJson(out, "allocations_per_frame", allocations);
+    out << "}";
+  }
+  out << "]}" << std::endl;
+  return 0;
+}
+
+// Renders the chart layer of a series at its default view to a PNG,
+// without opening a window.
+bool renderPng(const std::string &filename, const ChartSeries &series,
+               const sf::Font &font, unsigned width, unsigned height)
+{
+  const CandleSeries &candles = series.candles;
+  sf::RenderTexture target({width, height});
+  const float marginX = width * MARGIN_X_PERCENT;
+  const float chartTop = height * MARGIN_Y_PERCENT;
+  float viewEnd = static_cast<float>(candles.size() - 1);
+  float viewStart = std::max(0.f, viewEnd - 29);
+  Price minPrice, maxPrice;
+  queryPriceRange(series, static_cast<size_t>(viewStart),
+                  static_cast<size_t>(viewEnd), minPrice, maxPrice);
+  CandleBatch batch;
+  sf::VertexArray grid;
+  TextCache dateLabels;
+  dateLabels.font = &font;
+  target.clear(sf::Color::White);
+  drawChart(target, grid, batch, dateLabels, candles, series.pyramid,
+            viewStart, viewEnd, marginX, chartTop, width - 2 * marginX,
+            height - 4 * chartTop, fromPrice(minPrice), fromPrice(maxPrice));
+  target.display();
+  return target.getTexture().copyToImage().saveToFile(filename);
+}
+
+int main(int argc, char **argv)
+{
+  std::string followSource, tickSource, replaySource;
+  std::vector<std::string> symbolPaths;
+  size_t memoryBudgetMb = 2048;
+  size_t pageBudgetMb = 256;
+  size_t volumeBuckets = 50;
+  std::string fontPath = "/System/Library/Fonts/SFNSMono.ttf";
+  std::string renderPath, benchOutput, tracePath;
+  std::vector<size_t> benchSizes;
+  bool screen = false;
+  std::vector<ScreenFilter> screenFilters;
+  std::string screenOutput;
+  int64_t interval = 60;
+  double replaySpeed = 1.0;
+  size_t numThreads = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--follow" && i + 1 < argc) {
+      followSource = argv[++i];
+    } else if (arg == "--simulate-feed" && i + 1 < argc) {
+      return runFeedSimulator(std::atof(argv[++i]));
+    } else if (arg == "--ticks" && i + 1 < argc) {
+      tickSource = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replaySource = argv[++i];
+    } else if (arg == "--speed" && i + 1 < argc) {
+      replaySpeed = std::atof(argv[++i]);
+    } else if (arg == "--interval" && i + 1 < argc) {
+      if (!parseInterval(argv[++i], interval)) {
+        std::cerr << "Invalid interval: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (arg == "--parallel") {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    } else if (arg == "--simulate-ticks" && i + 2 < argc) {
+      size_t count = std::strtoull(argv[i + 1], nullptr, 10);
+      return writeSimulatedTicks(argv[i + 2], count);
+    } else if (arg == "--font" && i + 1 < argc) {
+      fontPath = argv[++i];
+    } else if (arg == "--render" && i + 1 < argc) {
+      renderPath = argv[++i];
+    } else if (arg == "--trace" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (arg == "--bench") {
+      benchSizes = {1000, 100000, 1000000, 10000000};
+    } else if (arg == "--bench-sizes" && i + 1 < argc) {
+      benchSizes.clear();
+      std::istringstream list(argv[++i]);
+      for (std::string size; std::getline(list, size, ',');)
+        benchSizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+    } else if (arg == "--bench-output" && i + 1 < argc) {
+      benchOutput = argv[++i];
+    } else if (arg == "--volume-buckets" && i + 1 < argc) {
+      volumeBuckets = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--memory-budget" && i + 1 < argc) {
+      memoryBudgetMb = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--screen") {
+      screen = true;
+    } else if ((arg == "--new-high" || arg == "--change" ||
+                arg == "--volume-spike" || arg == "--cross-above" ||
+                arg == "--cross-below") &&
+               i + 1 < argc) {
+      ScreenFilter filter;
+      if (!parseScreenFilter(arg, argv[++i], filter)) {
+        std::cerr << "Invalid " << arg << ": " << argv[i] << std::endl;
+        return 1;
+      }
+      screenFilters.push_back(filter);
+    } else if (arg == "--screen-output" && i + 1 < argc) {
+      screenOutput = argv[++i];
+    } else if (arg == "--page-budget" && i + 1 < argc) {
+      pageBudgetMb = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg.rfind("--", 0) != 0) {
+      symbolPaths.push_back(arg);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [CSV|DIRECTORY...] [--memory-budget MB]"
+                   " [--page-budget MB] [--volume-buckets N]"
+                   "\n       [--follow FILE|-|tcp:PORT] [--simulate-feed BARS_PER_SEC]"
+                   "\n       [--ticks FILE | --replay FILE [--speed X]]"
+                   " [--interval 1s|1m|5m|1h|1d] [--parallel]"
+                   "\n       [--simulate-ticks COUNT FILE]"
+                   "\n       [--font TTF] [--render PNG] [--trace JSON]"
+                   "\n       [--bench] [--bench-sizes N,...] [--bench-output JSON]"
+                   "\n       --screen [CSV|DIRECTORY...] [--new-high DAYS]"
+                   " [--change PCT[:BARS]]"
+                   "\n       [--volume-spike MULTIPLE[:BARS]]"
+                   " [--cross-above A:B] [--cross-below A:B]"
+                   "\n       [--screen-output CSV|JSON]"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (!followSource.empty() + !tickSource.empty() + !replaySource.empty() >
+      1) {
+    std::cerr << "--follow, --ticks and --replay are exclusive" << std::endl;
+    return 1;
+  }
+  if (replaySpeed <= 0.0) {
+    std::cerr << "Replay speed must be positive" << std::endl;
+    return 1;
+  }
+
+  if (screen)
+    return runScreener(symbolPaths.empty() ? std::vector<std::string>{"."}
+                                           : symbolPaths,
+                       screenFilters, screenOutput);
 
   // Font setup
   sf::Font font;
-  if (!font.openFromFile("/System/Library/Fonts/SFNSMono.ttf")) {
+  if (!font.openFromFile(fontPath)) {
     std::cerr << "Failed to load font!" << std::endl;
     return 1;
   }
 
+  if (!benchSizes.empty()) {
+    if (benchOutput.empty())
+      return runBenchmark(benchSizes, font, volumeBuckets, std::cout);
+    std::ofstream out(benchOutput);
+    return runBenchmark(benchSizes, font, volumeBuckets, out);
+  }
+
+  Workspace workspace;
+  workspace.memoryBudget = memoryBudgetMb << 20;
+  workspace.pageBudget = pageBudgetMb << 20;
+  AnnotationWriter annotationWriter;
+  TickFile replayFile;
+  TickReader replayReader{};
+  BarAggregator replayAggregator{interval * NANOSECONDS_PER_SECOND};
+  bool singleSource =
+      !followSource.empty() || !tickSource.empty() || !replaySource.empty();
+  if (singleSource) {
+    // Ticks and the CSV history of a live feed make a single chart
+    auto symbol = std::make_unique<Symbol>();
+    ChartSeries &base = symbol->series[TIMEFRAME_BASE];
+    CandleSeries &candles = base.candles;
+    ParseStats parseStats;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!replaySource.empty()) {
+      // Seed the chart with the first tick; the replay continues from there
+      symbol->name = replaySource;
+      if (!openTickFile(replaySource, replayFile, MADV_SEQUENTIAL)) {
+        std::cerr << "Failed to open file: " << replaySource << std::endl;
+        return 1;
+      }
+      replayReader = {replayFile.begin, replayFile.end, replayFile.binary};
+      Tick tick;
+      Candlestick unused;
+      if (nextTick(replayReader, tick)) {
+        addTick(replayAggregator, tick, unused);
+        candles.append(replayAggregator.bar);
+      }
+    } else if (!tickSource.empty()) {
+      symbol->name = tickSource;
+      candles = aggregateTickFile(tickSource, interval, numThreads,
+                                  &parseStats);
+      double loadMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - loadStart)
+                          .count();
+      std::cout << "Aggregated " << parseStats.rows << " ticks into "
+                << candles.size() << " bars in " << std::fixed
+                << std::setprecision(1) << loadMs << " ms ("
+                << parseStats.rows / 1e6 / parseStats.seconds
+                << " M ticks/s)" << std::endl;
+    } else {
+      symbol->name = symbolPaths.empty() ? "./NVDA.csv" : symbolPaths[0];
+      candles = loadCandles(symbol->name, &parseStats);
+      if (candles.empty()) { // Live bars extend the history's last bar
+        std::cerr << "No history to follow in " << symbol->name
+                  << ". Exiting." << std::endl;
+        return 1;
+      }
+    }
+    updateCandlePyramid(base.pyramid, candles);
+    updateRangeIndex(base.priceIndex, candles.low.data, candles.high.data,
+                     candles.size());
+    // Loaded even if empty, so the main loop reports it instead of waiting
+    symbol->state = SYMBOL_READY;
+    workspace.symbols.push_back(std::move(symbol));
+  } else {
+    if (symbolPaths.empty())
+      symbolPaths.push_back("./NVDA.csv");
+    for (const auto &path : findSymbolFiles(symbolPaths)) {
+      auto symbol = std::make_unique<Symbol>();
+      symbol->name = std::filesystem::path(path).stem().string();
+      symbol->path = path;
+      workspace.symbols.push_back(std::move(symbol));
+    }
+    if (workspace.symbols.empty()) {
+      std::cerr << "No data loaded. Exiting." << std::endl;
+      return 1;
+    }
+    for (auto &symbol : workspace.symbols)
+      requestSymbol(workspace, *symbol, symbol != workspace.symbols[0]);
+  }
+  for (auto &symbol : workspace.symbols) {
+    loadAnnotations(annotationWriter, *symbol);
+    placeAnnotations(workspace, *symbol);
+  }
+
+  if (!renderPath.empty()) {
+    // Render the first symbol to finish loading
+    const ChartSeries *rendered = nullptr;
+    while (!rendered) {
+      bool loading = false;
+      for (auto &symbol : workspace.symbols) {
+        int state = symbol->state.load(std::memory_order_acquire);
+        takeLoadedSeries(workspace, *symbol);
+        if (state == SYMBOL_READY &&
+            !symbol->series[TIMEFRAME_BASE].candles.empty()) {
+          rendered = &symbol->series[TIMEFRAME_BASE];
+          break;
+        }
+        loading |= state == SYMBOL_LOADING;
+      }
+      if (!rendered && !loading) {
+        std::cerr << "No data loaded. Exiting." << std::endl;
+        return 1;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!renderPng(renderPath, *rendered, font, 1400, 800)) {
+      std::cerr << "Failed to write " << renderPath << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  // The window opens at once; the first symbol is shown as its first bars
+  // arrive
+  constexpr size_t NO_SYMBOL = SIZE_MAX;
+  size_t pendingSymbol = 0;
+
+  LiveFeed feed;
+  bool live = !followSource.empty() || !replaySource.empty();
+  if (!followSource.empty() && !startLiveFeed(feed, followSource))
+    return 1;
+  if (!replaySource.empty())
+    feed.reader = std::thread(replayTicks, std::ref(feed), replayReader,
+                              replayAggregator, replaySpeed);
+
+  // Window setup
+  unsigned width = 1400, height = 800;
+  sf::RenderWindow window(sf::VideoMode({width, height}), "Candlesticks");
+  window.setVerticalSyncEnabled(!live); // Live bars should not wait for vsync
+
   // Chart dimensions
   const float marginX = width * MARGIN_X_PERCENT;
   const float marginY = height * MARGIN_Y_PERCENT;
   const float chartWidth = width - 2 * marginX;
   const float chartHeight = height - 2 * marginY * 2.f;
   const float chartTop = marginY;
-  const float chartBottom = chartTop + chartHeight;
 
-  // View setup
-  size_t numCandles = candles.size();
-  float viewStart = numCandles > 30 ? numCandles - 30 : 0;
-  float viewEnd = numCandles - 1;
-  float viewWidth = viewEnd - viewStart + 1;
-  float maxViewWidth = static_cast<float>(numCandles);
+  // View setup, restored per symbol when it is shown
+  Symbol *chart = nullptr;
+  size_t chartIndex = 0;
+  Timeframe requestedTimeframe = TIMEFRAME_BASE;
+  size_t numCandles = 0;
+  float viewStart = 0.f, viewEnd = 0.f, viewWidth = 0.f, maxViewWidth = 0.f;
   float currentViewStart = viewStart, currentViewEnd = viewEnd;
   float viewMinPrice = 0.f, viewMaxPrice = 0.f;
   bool viewChanged = true; // Force initial calculation
@@ -263,33 +5103,192 @@ int main()
   // Annotation variables
   bool isDrawingLine = false;
   ChartLine currentLine;
-  std::vector<ChartLine> lines;
 
   bool isDrawingRect = false;
   ChartRect currentRect;
-  std::vector<ChartRect> rects;
 
   bool isTyping = false;
   ChartText currentText;
   std::string inputBuffer;
-  std::vector<ChartText> texts;
   bool ignoreNextT = false;
 
-  // Modal variables
+  // Cached layers: grid, candles and labels; committed annotations
+  ChartLayers layers({width, height}, font, volumeBuckets);
+  sf::Sprite chartSprite(layers.chart.getTexture());
+  sf::Sprite annotationSprite(layers.annotations.getTexture());
+  bool showVolumeProfile = false;
+  std::array<bool, NUM_INDICATORS> indicatorsShown{};
+  bool chartChanged = true, annotationsChanged = true;
+  bool annotationsEdited = true;
+  uint64_t chartRevision = 0;
+
+  // Modal variables, rebuilt only when the hovered candle changes
   sf::RectangleShape modalRect;
-  sf::Text modalText(font);
+  modalRect.setFillColor(MODAL_FILL);
+  modalRect.setOutlineColor(sf::Color::Black);
+  modalRect.setOutlineThickness(1);
+  sf::Text modalText(font, "", 12);
+  modalText.setFillColor(sf::Color::Black);
   bool showModal = false;
+  size_t modalIndex = NO_CANDLE;
+  uint64_t modalRevision = 0;
+
+  // Load progress, shown until the chart's history is complete
+  sf::Text loadText(font, "", 14);
+  loadText.setFillColor(sf::Color::Black);
+  sf::RectangleShape loadBar;
+
+  // Profiler HUD and trace
+  bool showProfiler = false;
+  sf::Text profilerText(font, "", 12);
+  profilerText.setFillColor(sf::Color::White);
+  sf::RectangleShape profilerBackground;
+  profilerBackground.setFillColor(sf::Color(0, 0, 0, 180));
+  sf::VertexArray sparkline;
+  if (!tracePath.empty()) {
+    frameProfiler.enabled = frameProfiler.tracing = true;
+    countingAllocations = true;
+    frameProfiler.trace.reserve(1 << 16);
+  }
 
+  bool redraw = true; // Draw the first frame without waiting for input
+  std::chrono::steady_clock::time_point oldestPending;
+  size_t numPending = 0;
+  double pendingReceivedUs = 0.0;
   while (window.isOpen()) {
-    // Event handling
-    std::optional<sf::Event> event;
-    while ((event = window.pollEvent())) {
+    // Switch symbols once the requested one has bars to show
+    if (pendingSymbol != NO_SYMBOL) {
+      Symbol &next = *workspace.symbols[pendingSymbol];
+      int state = next.state.load(std::memory_order_acquire);
+      if (takeLoadedSeries(workspace, next))
+        placeAnnotations(workspace, next);
+      bool empty = next.series[TIMEFRAME_BASE].candles.empty();
+      if (state == SYMBOL_READY && empty) {
+        std::cerr << "No data for " << next.name << std::endl;
+        if (chart) {
+          pendingSymbol = NO_SYMBOL;
+          window.setTitle(symbolTitle(*chart));
+        } else if (pendingSymbol + 1 < workspace.symbols.size()) {
+          requestSymbol(workspace, *workspace.symbols[++pendingSymbol]);
+        } else {
+          std::cerr << "No data loaded. Exiting." << std::endl;
+          return 1;
+        }
+      } else if (!empty) {
+        if (chart) {
+          chart->viewStart = viewStart;
+          chart->viewEnd = viewEnd;
+        }
+        chartIndex = pendingSymbol;
+        chart = &next;
+        pendingSymbol = NO_SYMBOL;
+        chart->lastUsed = ++workspace.clock;
+        numCandles = currentSeries(workspace, *chart).candles.size();
+        maxViewWidth = static_cast<float>(numCandles);
+        viewEnd = std::min(chart->viewEnd, maxViewWidth - 1);
+        viewStart = chart->viewStart;
+        if (viewEnd < 0) { // First time shown
+          viewEnd = maxViewWidth - 1;
+          viewStart = std::max(0.f, viewEnd - 29);
+        }
+        viewWidth = viewEnd - viewStart + 1;
+        viewChanged = true;
+        chartChanged = true;
+        annotationsEdited = true;
+        modalIndex = NO_CANDLE;
+        requestedTimeframe = chart->timeframe;
+        window.setTitle(symbolTitle(*chart));
+        redraw = true;
+      }
+    }
+    if (!chart) {
+      // Nothing to show until the first bars arrive
+      for (auto event = window.waitEvent(LOADING_REFRESH_INTERVAL); event;
+           event = window.pollEvent()) {
+        auto *keyEvent = event->getIf<sf::Event::KeyPressed>();
+        if (event->is<sf::Event::Closed>() ||
+            (keyEvent && keyEvent->code == sf::Keyboard::Key::Q))
+          window.close();
+      }
+      const Symbol &next = *workspace.symbols[pendingSymbol];
+      window.clear(sf::Color::White);
+      drawLoadProgress(window, loadText, loadBar, "Loading " + next.name,
+                       next.loadProgress, marginX, height / 2.f, chartWidth);
+      window.display();
+      continue;
+    }
+    if (chart->partial) {
+      // Older bars arrive at the front; shift the view to stay on the same
+      // bars. Annotations are shown and editable once the history is
+      // complete.
+      size_t oldSize = chart->series[TIMEFRAME_BASE].candles.size();
+      if (takeLoadedSeries(workspace, *chart)) {
+        placeAnnotations(workspace, *chart);
+        numCandles = chart->series[TIMEFRAME_BASE].candles.size();
+        maxViewWidth = static_cast<float>(numCandles);
+        viewStart += static_cast<float>(numCandles - oldSize);
+        viewEnd += static_cast<float>(numCandles - oldSize);
+        viewChanged = true;
+        chartChanged = true;
+        annotationsEdited = true;
+        modalIndex = NO_CANDLE;
+        redraw = true;
+      }
+    }
+    if (requestedTimeframe != chart->timeframe) {
+      switchTimeframe(workspace, *chart, requestedTimeframe, viewStart,
+                      viewEnd);
+      // Keep at least the minimum width and stay within the new series
+      numCandles = chart->series[chart->timeframe].candles.size();
+      maxViewWidth = static_cast<float>(numCandles);
+      float minWidth = std::min(MIN_VIEW_WIDTH, maxViewWidth);
+      if (viewEnd - viewStart + 1 < minWidth) {
+        viewStart = (viewStart + viewEnd + 1 - minWidth) / 2;
+        viewEnd = viewStart + minWidth - 1;
+      }
+      if (viewStart < 0) {
+        viewEnd -= viewStart;
+        viewStart = 0;
+      }
+      if (viewEnd > maxViewWidth - 1) {
+        viewStart = std::max(0.f, viewStart - (viewEnd - maxViewWidth + 1));
+        viewEnd = maxViewWidth - 1;
+      }
+      viewWidth = viewEnd - viewStart + 1;
+      isDrawingLine = isDrawingRect = false;
+      viewChanged = true;
+      chartChanged = true;
+      annotationsEdited = true;
+      modalIndex = NO_CANDLE;
+      window.setTitle(symbolTitle(*chart));
+    }
+    if (workspace.residentBytes > workspace.memoryBudget)
+      enforceMemoryBudget(workspace, chart);
+    ChartSeries &shown = currentSeries(workspace, *chart);
+    CandleSeries &candles = shown.candles;
+    std::vector<ChartLine> &lines = chart->lines;
+    std::vector<ChartRect> &rects = chart->rects;
+    std::vector<ChartText> &texts = chart->texts;
+
+    // Event handling: sleep until something happens, then drain the queue.
+    // A live feed is polled instead, and loads are checked on a timeout,
+    // since they make progress without events.
+    bool loading = pendingSymbol != NO_SYMBOL || chart->partial;
+    std::optional<sf::Event> event =
+        redraw || live ? window.pollEvent()
+        : loading      ? window.waitEvent(LOADING_REFRESH_INTERVAL)
+                       : window.waitEvent();
+    beginFrame(frameProfiler);
+    ScopedTimer eventsTimer(PHASE_EVENTS);
+    for (; event; event = window.pollEvent()) {
+      redraw = true;
       if (event->is<sf::Event::Closed>())
         window.close();
       else if (auto *keyEvent = event->getIf<sf::Event::KeyPressed>()) {
         if (keyEvent->code == sf::Keyboard::Key::Q)
           window.close();
-        else if (keyEvent->code == sf::Keyboard::Key::T && !isTyping) {
+        else if (keyEvent->code == sf::Keyboard::Key::T && !isTyping &&
+                 !chart->partial) {
           isTyping = true;
           ignoreNextT = true;
           inputBuffer.clear();
@@ -302,9 +5301,52 @@ int main()
                                  (viewMaxPrice - viewMinPrice);
         } else if (keyEvent->code == sf::Keyboard::Key::Enter && isTyping) {
           currentText.text = inputBuffer;
-          if (!currentText.text.empty())
+          if (!currentText.text.empty()) {
             texts.push_back(currentText);
+            saveAnnotation(annotationWriter, *chart, ADD_TEXT,
+                           currentText.candle, currentText.price, 0.f, 0.f,
+                           currentText.text);
+            annotationsEdited = true;
+          }
           isTyping = false;
+        } else if ((keyEvent->code == sf::Keyboard::Key::PageDown ||
+                    keyEvent->code == sf::Keyboard::Key::PageUp) &&
+                   workspace.symbols.size() > 1) {
+          size_t count = workspace.symbols.size();
+          size_t from = pendingSymbol != NO_SYMBOL ? pendingSymbol : chartIndex;
+          pendingSymbol =
+              keyEvent->code == sf::Keyboard::Key::PageDown
+                  ? (from + 1) % count
+                  : (from + count - 1) % count;
+          requestSymbol(workspace, *workspace.symbols[pendingSymbol]);
+          window.setTitle("Candlesticks - " +
+                          workspace.symbols[pendingSymbol]->name +
+                          " (loading)");
+        } else if (keyEvent->code >= sf::Keyboard::Key::Num0 &&
+                   keyEvent->code <= sf::Keyboard::Key::Num9 && !isTyping) {
+          // 1-9 toggle the first nine indicators, 0 the tenth
+          int digit = static_cast<int>(keyEvent->code) -
+                      static_cast<int>(sf::Keyboard::Key::Num0);
+          size_t which = digit == 0 ? 9 : digit - 1;
+          if (which < NUM_INDICATORS) {
+            indicatorsShown[which] = !indicatorsShown[which];
+            chartChanged = true;
+          }
+        } else if (keyEvent->code >= sf::Keyboard::Key::F1 &&
+                   keyEvent->code <= sf::Keyboard::Key::F4 && !isTyping &&
+                   !chart->partial) {
+          // F1 shows the bars as loaded, F2-F4 weekly, monthly, quarterly
+          requestedTimeframe = static_cast<Timeframe>(
+              static_cast<int>(keyEvent->code) -
+              static_cast<int>(sf::Keyboard::Key::F1));
+        } else if (keyEvent->code == sf::Keyboard::Key::V && !isTyping) {
+          showVolumeProfile = !showVolumeProfile;
+          chartChanged = true;
+        } else if (keyEvent->code == sf::Keyboard::Key::P && !isTyping) {
+          showProfiler = !showProfiler;
+          frameProfiler.enabled = showProfiler || frameProfiler.tracing;
+          countingAllocations = frameProfiler.enabled;
+          beginFrame(frameProfiler);
         } else if (keyEvent->code == sf::Keyboard::Key::F) {
           viewStart = 0;
           viewEnd = numCandles - 1;
@@ -328,14 +5370,22 @@ int main()
           }
           viewChanged = true;
         } else if (keyEvent->code == sf::Keyboard::Key::D && !lines.empty() &&
-                   !isTyping) {
+                   !isTyping && !chart->partial) {
           lines.pop_back(); // Delete last line
+          saveAnnotation(annotationWriter, *chart, DELETE_LINE);
+          annotationsEdited = true;
         } else if (keyEvent->code == sf::Keyboard::Key::R && !rects.empty() &&
-                   !isTyping) {
+                   !isTyping && !chart->partial) {
           rects.pop_back(); // Delete last rectangle
+          saveAnnotation(annotationWriter, *chart, DELETE_RECT);
+          annotationsEdited = true;
         } else if (keyEvent->code == sf::Keyboard::Key::Y && !texts.empty() &&
-                   !isTyping) {
+                   !isTyping && !chart->partial) {
           texts.pop_back(); // Delete last text
+          saveAnnotation(annotationWriter, *chart, DELETE_TEXT);
+          annotationsEdited = true;
+        } else if (keyEvent->code == sf::Keyboard::Key::E && !isTyping) {
+          saveAnnotation(annotationWriter, *chart, EXPORT_JSON);
         }
       } else if (auto *textEvent = event->getIf<sf::Event::TextEntered>()) {
         if (isTyping && textEvent->unicode < 128) {
@@ -374,7 +5424,8 @@ int main()
           viewChanged = true;
         }
       } else if (auto *mouseEvent =
-                     event->getIf<sf::Event::MouseButtonPressed>()) {
+                     event->getIf<sf::Event::MouseButtonPressed>();
+                 mouseEvent && !chart->partial) {
         float mouseX = static_cast<float>(mouseEvent->position.x);
         float mouseY = static_cast<float>(mouseEvent->position.y);
         if (mouseEvent->button == sf::Mouse::Button::Left) {
@@ -410,6 +5461,10 @@ int main()
                   : viewMaxPrice - ((mouseY - chartTop) / chartHeight) *
                                        (viewMaxPrice - viewMinPrice);
           lines.push_back(currentLine);
+          saveAnnotation(annotationWriter, *chart, ADD_LINE,
+                         currentLine.startCandle, currentLine.startPrice,
+                         currentLine.endCandle, currentLine.endPrice);
+          annotationsEdited = true;
           isDrawingLine = false;
         } else if (mouseEvent->button == sf::Mouse::Button::Right &&
                    isDrawingRect) {
@@ -419,11 +5474,82 @@ int main()
               viewMaxPrice - ((mouseY - chartTop) / chartHeight) *
                                  (viewMaxPrice - viewMinPrice);
           rects.push_back(currentRect);
+          saveAnnotation(annotationWriter, *chart, ADD_RECT,
+                         currentRect.startCandle, currentRect.startPrice,
+                         currentRect.endCandle, currentRect.endPrice);
+          annotationsEdited = true;
           isDrawingRect = false;
         }
       }
     }
 
+    eventsTimer.stop();
+
+    // Append bars from the live feed to the base series, following the
+    // right edge if the view is pinned there. The history it continues is
+    // never empty.
+    if (live) {
+      ScopedTimer timer(PHASE_FEED);
+      ChartSeries &base = chart->series[TIMEFRAME_BASE];
+      CandleSeries &baseCandles = base.candles;
+      size_t dirtyFrom = baseCandles.size();
+      LiveBar bar;
+      while (feed.queue.pop(bar)) {
+        if (base.pages.budgetChunks) { // Live bars are appended in memory
+          unpageSeries(base);
+          workspace.residentBytes -= chart->bytes;
+          chart->bytes = symbolBytes(*chart);
+          workspace.residentBytes += chart->bytes;
+        }
+        int64_t lastTime = baseCandles.time[baseCandles.size() - 1];
+        if (bar.candle.time < lastTime) {
+          std::cerr << "Skipping out-of-order bar "
+                    << formatDate(bar.candle.time) << std::endl;
+          continue;
+        }
+        if (bar.candle.time == lastTime) { // Update of the current bar
+          baseCandles.set(baseCandles.size() - 1, bar.candle);
+          dirtyFrom = std::min(dirtyFrom, baseCandles.size() - 1);
+        } else {
+          baseCandles.append(bar.candle);
+        }
+        if (numPending++ == 0)
+          oldestPending = bar.received;
+        pendingReceivedUs += std::chrono::duration<double, std::micro>(
+                                 bar.received.time_since_epoch())
+                                 .count();
+      }
+      if (numPending > 0) {
+        updateCandlePyramid(base.pyramid, baseCandles, dirtyFrom);
+        updateRangeIndex(base.priceIndex, baseCandles.low.data,
+                         baseCandles.high.data, baseCandles.size(),
+                         dirtyFrom);
+        invalidateIndicators(base.indicators, dirtyFrom);
+        for (size_t t = TIMEFRAME_WEEK; t < NUM_TIMEFRAMES; ++t)
+          chart->series[t].staleFrom =
+              std::min(chart->series[t].staleFrom, dirtyFrom);
+        if (chart->timeframe != TIMEFRAME_BASE) {
+          currentSeries(workspace, *chart);
+          dirtyFrom = barCovering(shown.baseStarts, dirtyFrom);
+        }
+        bool pinned = viewEnd >= numCandles - 1;
+        numCandles = candles.size();
+        maxViewWidth = static_cast<float>(numCandles);
+        if (pinned) {
+          viewEnd = numCandles - 1;
+          viewStart = std::max(0.f, viewEnd - viewWidth + 1);
+        }
+        if (pinned || static_cast<size_t>(viewEnd) >= dirtyFrom)
+          viewChanged = true;
+        redraw = true;
+      }
+    }
+    if (!redraw) {
+      sf::sleep(LIVE_POLL_INTERVAL);
+      continue;
+    }
+    redraw = false;
+
     // Update active drawing
     if (isDrawingLine || isDrawingRect) {
       float mouseX = static_cast<float>(sf::Mouse::getPosition(window).x);
@@ -448,16 +5574,18 @@ int main()
 
     // Update view min/max prices if view changed
     if (viewChanged) {
+      ScopedTimer timer(PHASE_MINMAX);
       currentViewStart = viewStart;
       currentViewEnd = viewEnd;
-      viewMinPrice = candles[static_cast<size_t>(viewStart)].low;
-      viewMaxPrice = candles[static_cast<size_t>(viewStart)].high;
-      for (size_t i = static_cast<size_t>(viewStart);
-           i <= static_cast<size_t>(viewEnd); ++i) {
-        viewMinPrice = std::min(viewMinPrice, candles[i].low);
-        viewMaxPrice = std::max(viewMaxPrice, candles[i].high);
-      }
+      size_t first = static_cast<size_t>(viewStart);
+      size_t last = static_cast<size_t>(viewEnd);
+      updatePageWindow(shown, first, last);
+      Price minPrice, maxPrice;
+      queryPriceRange(shown, first, last, minPrice, maxPrice);
+      viewMinPrice = fromPrice(minPrice);
+      viewMaxPrice = fromPrice(maxPrice);
       viewChanged = false;
+      chartChanged = true;
     }
 
     // Calculate candle dimensions
@@ -466,68 +5594,70 @@ int main()
     float spacing = totalWidthPerCandle * SPACING_FACTOR;
 
     // Hover detection (includes wicks)
+    ScopedTimer hoverTimer(PHASE_HOVER);
     sf::Vector2f mousePosF =
         static_cast<sf::Vector2f>(sf::Mouse::getPosition(window));
-    showModal = false;
-    for (size_t i = static_cast<size_t>(viewStart);
-         i <= static_cast<size_t>(viewEnd); ++i) {
-      const auto &candle = candles[i];
-      float x = marginX + ((i - viewStart) * (candleWidth + spacing));
-      float highY = chartTop + ((viewMaxPrice - candle.high) /
-                                (viewMaxPrice - viewMinPrice) * chartHeight);
-      float lowY = chartTop + ((viewMaxPrice - candle.low) /
-                               (viewMaxPrice - viewMinPrice) * chartHeight);
-      sf::FloatRect candleRect({x, highY}, {candleWidth, lowY - highY});
-      if (candleRect.contains(mousePosF)) {
-        std::stringstream ss;
-        ss << "Date:   " << candle.date << "\n"
-           << "Open:   " << std::fixed << std::setprecision(2) << candle.open << "\n"
-           << "High:   " << std::fixed << std::setprecision(2) << candle.high << "\n"
-           << "Low:    " << std::fixed << std::setprecision(2) << candle.low << "\n"
-           << "Close:  " << std::fixed << std::setprecision(2) << candle.close << "\n"
-           << "Volume: " << candle.volume;
-        modalText = sf::Text(font, ss.str(), 12);
-        modalText.setFillColor(sf::Color::Black);
-        sf::FloatRect bounds = modalText.getLocalBounds();
-        float padding = 5.f;
-        modalRect = sf::RectangleShape(
-            {bounds.size.x + 2 * padding, bounds.size.y + 2 * padding});
-        modalRect.setFillColor(MODAL_FILL);
-        modalRect.setOutlineColor(sf::Color::Black);
-        modalRect.setOutlineThickness(1);
-        sf::Vector2f pos = mousePosF + sf::Vector2f(10.f, 10.f);
-        if (pos.x + modalRect.getSize().x > width)
-          pos.x = width - modalRect.getSize().x;
-        if (pos.y + modalRect.getSize().y > height)
-          pos.y = height - modalRect.getSize().y;
-        if (pos.x < 0)
-          pos.x = 0;
-        if (pos.y < 0)
-          pos.y = 0;
-        modalRect.setPosition(pos);
-        modalText.setPosition(pos + sf::Vector2f(padding, padding));
-        showModal = true;
-        break;
-      }
+    size_t hovered = hitTestCandle(candles, mousePosF, viewStart, viewEnd,
+                                   marginX, chartTop, chartHeight, candleWidth,
+                                   spacing, viewMinPrice, viewMaxPrice);
+    showModal = hovered != NO_CANDLE;
+    if (showModal &&
+        (hovered != modalIndex || candles.revision != modalRevision)) {
+      modalIndex = hovered;
+      modalRevision = candles.revision;
+      std::stringstream ss;
+      Candlestick candle = candles.at(hovered);
+      ss << "Date:   " << formatDate(candle.time) << "\n"
+         << "Open:   " << std::fixed << std::setprecision(2) << candle.open << "\n"
+         << "High:   " << std::fixed << std::setprecision(2) << candle.high << "\n"
+         << "Low:    " << std::fixed << std::setprecision(2) << candle.low << "\n"
+         << "Close:  " << std::fixed << std::setprecision(2) << candle.close << "\n"
+         << "Volume: " << candle.volume;
+      modalText.setString(ss.str());
+      sf::FloatRect bounds = modalText.getLocalBounds();
+      modalRect.setSize({bounds.size.x + 2 * MODAL_PADDING,
+                         bounds.size.y + 2 * MODAL_PADDING});
+    }
+    if (showModal) {
+      sf::Vector2f pos = mousePosF + sf::Vector2f(10.f, 10.f);
+      if (pos.x + modalRect.getSize().x > width)
+        pos.x = width - modalRect.getSize().x;
+      if (pos.y + modalRect.getSize().y > height)
+        pos.y = height - modalRect.getSize().y;
+      if (pos.x < 0)
+        pos.x = 0;
+      if (pos.y < 0)
+        pos.y = 0;
+      modalRect.setPosition(pos);
+      modalText.setPosition(pos + sf::Vector2f(MODAL_PADDING, MODAL_PADDING));
     }
+    hoverTimer.stop();
 
-    // Drawing
-    window.clear(sf::Color::White);
+    // Re-render the cached layers only when their content changed
+    if (chartChanged || candles.revision != chartRevision) {
+      renderChartLayer(layers, shown, indicatorsShown, showVolumeProfile,
+                       viewStart, viewEnd, marginX, chartTop, chartWidth,
+                       chartHeight, viewMinPrice, viewMaxPrice);
+      chartRevision = candles.revision;
+      annotationsChanged = true; // Annotations follow the view
+    }
+    if (annotationsChanged || annotationsEdited)
+      renderAnnotationLayer(layers, lines, rects, texts, annotationsEdited,
+                            viewStart, viewEnd, marginX, chartTop, chartWidth,
+                            chartHeight, viewMinPrice, viewMaxPrice);
+    chartChanged = annotationsChanged = annotationsEdited = false;
 
-    drawGridLines(window, viewStart, viewEnd, marginX, chartTop, chartWidth,
-                  chartHeight, candleWidth, spacing, viewMinPrice,
-                  viewMaxPrice);
-    drawCandlesticks(window, candles, viewStart, viewEnd, marginX, chartTop,
-                     chartHeight, candleWidth, spacing, viewMinPrice,
-                     viewMaxPrice);
-    drawDateLabels(window, candles, viewStart, viewEnd, marginX, chartBottom,
-                   chartWidth, candleWidth, spacing, font);
-    drawLines(window, lines, viewStart, viewEnd, marginX, chartTop, chartWidth,
-              chartHeight, viewMinPrice, viewMaxPrice);
-    drawRectangles(window, rects, viewStart, viewEnd, marginX, chartTop,
-                   chartWidth, chartHeight, viewMinPrice, viewMaxPrice);
-    drawTexts(window, texts, viewStart, viewEnd, marginX, chartTop, chartWidth,
-              chartHeight, viewMinPrice, viewMaxPrice, font);
+    // Drawing: composite the layers, then the interactive overlays
+    ScopedTimer compositeTimer(PHASE_COMPOSITE);
+    window.clear(sf::Color::White);
+    submitDraw(window, chartSprite);
+    if (!chart->partial)
+      submitDraw(window, annotationSprite);
+    else
+      drawLoadProgress(window, loadText, loadBar,
+                       "Loading history of " + chart->name,
+                       chart->loadProgress, marginX, height - 2 * marginY,
+                       chartWidth);
 
     if (isDrawingLine) {
       float startX =
@@ -541,7 +5671,7 @@ int main()
                                (viewMaxPrice - viewMinPrice) * chartHeight);
       sf::Vertex activeLine[] = {{{startX, startY}, sf::Color::Blue},
                                  {{endX, endY}, sf::Color::Blue}};
-      window.draw(activeLine, 2, sf::PrimitiveType::Lines);
+      submitDraw(window, activeLine, 2, sf::PrimitiveType::Lines);
     } else if (isDrawingRect) {
       float startX =
           marginX +
@@ -558,7 +5688,7 @@ int main()
       activeRect.setFillColor(sf::Color(0, 0, 0, 51));
       activeRect.setOutlineColor(sf::Color::Black);
       activeRect.setOutlineThickness(1);
-      window.draw(activeRect);
+      submitDraw(window, activeRect);
     }
 
     if (isTyping) {
@@ -569,14 +5699,55 @@ int main()
       sf::Text textObj(font, inputBuffer + "_", 16);
       textObj.setFillColor(sf::Color::Black);
       textObj.setPosition({x, y});
-      window.draw(textObj);
+      submitDraw(window, textObj);
     }
 
     if (showModal) {
-      window.draw(modalRect);
-      window.draw(modalText);
+      submitDraw(window, modalRect);
+      submitDraw(window, modalText);
     }
 
-    window.display();
+    if (showProfiler)
+      drawProfilerHud(window, profilerText, profilerBackground, sparkline,
+                      frameProfiler, static_cast<float>(width));
+    compositeTimer.stop();
+
+    {
+      ScopedTimer timer(PHASE_DISPLAY);
+      window.display();
+    }
+    endFrame(frameProfiler);
+
+    if (numPending > 0) {
+      auto now = std::chrono::steady_clock::now();
+      double nowUs = std::chrono::duration<double, std::micro>(
+                         now.time_since_epoch())
+                         .count();
+      feed.numBars += numPending;
+      feed.totalLatencyUs += numPending * nowUs - pendingReceivedUs;
+      feed.maxLatencyUs = std::max(
+          feed.maxLatencyUs,
+          std::chrono::duration<double, std::micro>(now - oldestPending)
+              .count());
+      numPending = 0;
+      pendingReceivedUs = 0.0;
+    }
+  }
+
+  if (!tracePath.empty()) {
+    if (writeChromeTrace(tracePath, frameProfiler))
+      std::cout << "Wrote " << frameProfiler.trace.size()
+                << " trace events to " << tracePath << std::endl;
+    else
+      std::cerr << "Failed to write trace: " << tracePath << std::endl;
+  }
+
+  if (live) {
+    stopLiveFeed(feed);
+    if (feed.numBars > 0)
+      std::cout << "Live feed: " << feed.numBars
+                << " bars, ingest-to-frame latency avg " << std::setprecision(0)
+                << feed.totalLatencyUs / feed.numBars << " us, max "
+                << feed.maxLatencyUs << " us" << std::endl;
   }
 }
@@ -0,0 +1,61 @@
+// Column tests. Build from this directory with
+//   g++ -std=c++20 column_test.cpp -o column_test -pthread
+//       -lsfml-graphics -lsfml-window -lsfml-system
+#define main candlesticks_main
+#include "../main.cpp"
+#undef main
+
+#include <cassert>
+
+// Appending to a column borrowed from a read-only mapping must copy it
+// first rather than write past the mapping.
+void testAppendToBorrowed()
+{
+  constexpr size_t COUNT = 100;
+  size_t bytes = COUNT * sizeof(int64_t);
+  void *mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(mapped != MAP_FAILED);
+  auto *values = static_cast<int64_t *>(mapped);
+  for (size_t i = 0; i < COUNT; i++)
+    values[i] = static_cast<int64_t>(i);
+  ::mprotect(mapped, bytes, PROT_READ);
+
+  Column<int64_t> column;
+  column.borrow(values, COUNT);
+  column.push_back(COUNT);
+  assert(column.size == COUNT + 1);
+  assert(column.capacity > COUNT);
+  assert(column.data != values);
+  for (size_t i = 0; i <= COUNT; i++)
+    assert(column[i] == static_cast<int64_t>(i));
+  column.release();
+  ::munmap(mapped, bytes);
+}
+
+void testAppendToBorrowedSeries()
+{
+  CandleSeries source;
+  for (int i = 0; i < 10; i++)
+    source.append({1.f + i, 2.f + i, 3.f + i, 0.5f + i, 100.f, 1000 + i});
+  CandleSeries borrowed;
+  borrowed.open.borrow(source.open.data, source.size());
+  borrowed.high.borrow(source.high.data, source.size());
+  borrowed.low.borrow(source.low.data, source.size());
+  borrowed.close.borrow(source.close.data, source.size());
+  borrowed.volume.borrow(source.volume.data, source.size());
+  borrowed.time.borrow(source.time.data, source.size());
+  borrowed.append({20.f, 21.f, 22.f, 19.f, 50.f, 2000});
+  assert(borrowed.size() == 11);
+  assert(source.size() == 10);
+  assert(borrowed.time[9] == 1009 && borrowed.time[10] == 2000);
+  assert(borrowed.open.data != source.open.data);
+}
+
+int main()
+{
+  testAppendToBorrowed();
+  testAppendToBorrowedSeries();
+  std::cout << "column tests passed\n";
+  return 0;
+}